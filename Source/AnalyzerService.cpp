@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    Process-wide spectrum analyzer scheduling, shared by every plugin instance.
+
+  ==============================================================================
+*/
+
+#include "AnalyzerService.h"
+
+#include <map>
+
+FFTResources::FFTResources(FFTOrder order) :
+forwardFFT(order),
+window((size_t)(1 << order), juce::dsp::WindowingFunction<float>::blackmanHarris)
+{
+}
+
+std::shared_ptr<FFTResources> FFTResources::getShared(FFTOrder order)
+{
+    // Only weak references are kept here, so the tables are freed once the last analyzer lets go
+    static juce::CriticalSection lock;
+    static std::map<int, std::weak_ptr<FFTResources>> sharedResources;
+
+    const juce::ScopedLock sl(lock);
+
+    auto& weakResources = sharedResources[order];
+    auto resources = weakResources.lock();
+
+    if (resources == nullptr)
+    {
+        resources = std::make_shared<FFTResources>(order);
+        weakResources = resources;
+    }
+
+    return resources;
+}
+
+//==============================================================================
+
+AnalyzerService::AnalyzerService()
+{
+    // Leave a core for the audio and message threads
+    auto numWorkers = juce::jlimit(1, 4, juce::SystemStats::getNumCpus() - 1);
+
+    for (int i = 0; i < numWorkers; i++)
+    {
+        workers.push_back(std::make_unique<Worker>(*this, i));
+        workers.back()->startThread();
+    }
+}
+
+AnalyzerService::~AnalyzerService()
+{
+    stopTimer();
+    workers.clear();
+}
+
+void AnalyzerService::addStream(AnalyzerStream* stream)
+{
+    {
+        const juce::ScopedWriteLock sl(streamsLock);
+        streams.addIfNotAlreadyThere(stream);
+        numStreams = streams.size();
+    }
+
+    if (! isTimerRunning())
+        startTimer(1000 / frameRateHz);
+}
+
+void AnalyzerService::removeStream(AnalyzerStream* stream)
+{
+    // Taking the write lock waits for any worker that is still processing this stream
+    const juce::ScopedWriteLock sl(streamsLock);
+    streams.removeFirstMatchingValue(stream);
+    numStreams = streams.size();
+
+    // Nothing left to analyze, so stop waking the workers up
+    if (streams.isEmpty())
+        stopTimer();
+}
+
+void AnalyzerService::hiResTimerCallback()
+{
+    currentFrame++;
+
+    auto numWorkersToWake = juce::jmin((int)workers.size(), numStreams.load());
+    for (int i = 0; i < numWorkersToWake; i++)
+        workers[(size_t)i]->notify();
+}
+
+void AnalyzerService::processStreams()
+{
+    const juce::ScopedReadLock sl(streamsLock);
+    const auto frame = currentFrame.load();
+
+    for (auto* stream : streams)
+    {
+        // Claim the stream for this frame. Whichever worker gets there first processes it,...
+        // ...so the streams spread out over however many workers are free.
+        auto lastFrame = stream->lastProcessedFrame.load();
+
+        if (lastFrame < frame && stream->lastProcessedFrame.compare_exchange_strong(lastFrame, frame))
+            stream->processFrame();
+    }
+}
+
+//==============================================================================
+
+AnalyzerService::Worker::Worker(AnalyzerService& s, int index) :
+juce::Thread("3BandEQ Analyzer " + juce::String(index)),
+service(s)
+{
+}
+
+void AnalyzerService::Worker::run()
+{
+    while (! threadShouldExit())
+    {
+        // Sleep until the next frame starts
+        wait(-1);
+
+        if (threadShouldExit())
+            return;
+
+        service.processStreams();
+    }
+}
@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    Process-wide spectrum analyzer scheduling, shared by every plugin instance.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+enum FFTOrder
+{
+    ORDER_2048 = 11,
+    ORDER_4096 = 12,
+    ORDER_8192 = 13
+};
+
+// FFT plan and window table for one FFT order.
+// These are only ever read after construction, so every analyzer of the same order...
+// ...in the process shares one copy, whichever thread it runs on.
+struct FFTResources
+{
+    FFTResources(FFTOrder order);
+
+    juce::dsp::FFT forwardFFT;
+    juce::dsp::WindowingFunction<float> window;
+
+    // Returns the shared resources for this order, creating them if nobody is using them yet
+    static std::shared_ptr<FFTResources> getShared(FFTOrder order);
+};
+
+// Something the analyzer service should process once per display frame
+struct AnalyzerStream
+{
+    virtual ~AnalyzerStream() = default;
+
+    // Called from one of the service's worker threads
+    virtual void processFrame() = 0;
+private:
+    friend class AnalyzerService;
+    // The last frame a worker claimed this stream for
+    std::atomic<juce::int64> lastProcessedFrame {-1};
+};
+
+// A small pool of worker threads that runs every registered AnalyzerStream at the display rate.
+// Use it through a juce::SharedResourcePointer<AnalyzerService>, so all the instances of the...
+// ...plugin in a process share it, and it only exists while at least one editor is open.
+class AnalyzerService : private juce::HighResolutionTimer
+{
+public:
+    AnalyzerService();
+    ~AnalyzerService() override;
+
+    // Called from the message thread
+    void addStream(AnalyzerStream* stream);
+    // Called from the message thread. Once this returns, the stream is no longer being processed.
+    void removeStream(AnalyzerStream* stream);
+
+    static constexpr int frameRateHz = 60;
+private:
+    struct Worker : juce::Thread
+    {
+        Worker(AnalyzerService& service, int index);
+        ~Worker() override { stopThread(1000); }
+
+        void run() override;
+
+        AnalyzerService& service;
+    };
+
+    // Starts a new frame, and wakes up as many workers as there are streams to process
+    void hiResTimerCallback() override;
+    // Called by each worker. Processes every stream that no other worker has claimed this frame.
+    void processStreams();
+
+    juce::ReadWriteLock streamsLock;
+    juce::Array<AnalyzerStream*> streams;
+    std::atomic<int> numStreams {0};
+
+    std::atomic<juce::int64> currentFrame {0};
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AnalyzerService)
+};
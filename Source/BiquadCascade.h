@@ -0,0 +1,369 @@
+/*
+  ==============================================================================
+
+    Multichannel biquad cascade, processing one channel per SIMD lane.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <utility>
+#include <vector>
+
+// Plain biquad coefficients, normalised so that a0 == 1 (the same order JUCE stores them in)
+template<typename SampleType>
+struct BiquadCoefficients
+{
+    SampleType b0 {1}, b1 {0}, b2 {0}, a1 {0}, a2 {0};
+    
+    // Rounds (or widens) every coefficient to another precision
+    template<typename OtherType>
+    BiquadCoefficients<OtherType> withPrecision() const
+    {
+        return { (OtherType)b0, (OtherType)b1, (OtherType)b2, (OtherType)a1, (OtherType)a2 };
+    }
+};
+
+// Filters are always designed in double precision, and only rounded to the processing precision...
+// ...at the very end. Low cut sections at low frequencies and high sample rates need the headroom.
+using DesignedCoefficients = BiquadCoefficients<double>;
+
+// How many samples a biquad's impulse response takes to die down by decayFactor (e.g. 1e-6 for -120 dB),...
+// ...going by its slowest pole. Poles on or outside the unit circle never die down, so those get maxSamples.
+inline double getBiquadDecayTimeInSamples(const DesignedCoefficients& c, double decayFactor, double maxSamples)
+{
+    // The poles are the roots of z^2 + a1 z + a2
+    const auto discriminant = c.a1 * c.a1 - 4.0 * c.a2;
+    auto poleRadius = 0.0;
+    
+    if (discriminant < 0.0)
+    {
+        // A complex pair, both the same distance from the origin
+        poleRadius = std::sqrt(c.a2);
+    }
+    else
+    {
+        const auto root = std::sqrt(discriminant);
+        poleRadius = juce::jmax(std::abs(-c.a1 + root), std::abs(-c.a1 - root)) / 2.0;
+    }
+    
+    if (poleRadius >= 1.0)
+        return maxSamples;
+    
+    // No feedback at all: done once the input has gone through both delays
+    if (poleRadius <= 0.0)
+        return 2.0;
+    
+    return juce::jmin(maxSamples, std::log(decayFactor) / std::log(poleRadius));
+}
+
+// One SIMD register holds the same sample for several channels (one channel per lane)
+template<typename SampleType>
+using SIMDRegister = juce::dsp::SIMDRegister<SampleType>;
+// (4 floats or 2 doubles with SSE and NEON)
+template<typename SampleType>
+constexpr size_t numSIMDLanes = SIMDRegister<SampleType>::SIMDNumElements;
+
+// Up to MaxSections biquads in series, of which only the first few are active...
+// ...(e.g. a cut filter, whose slope decides how many 12 dB/oct sections it uses).
+// Every channel uses the same coefficients, so the coefficients are stored once...
+// ...and the filter state of all channels sits side by side in one register per section.
+template<typename SampleType, size_t MaxSections>
+struct SIMDBiquadCascade
+{
+    using Register = SIMDRegister<SampleType>;
+    using SectionCoefficients = BiquadCoefficients<SampleType>;
+    
+    // Jumps straight to new coefficients
+    void setCoefficients(size_t index, const DesignedCoefficients& newCoefficients)
+    {
+        jassert(index < MaxSections);
+        coefficients[index] = newCoefficients.template withPrecision<SampleType>();
+        targetCoefficients[index] = coefficients[index];
+        increments[index] = { 0, 0, 0, 0, 0 };
+    }
+    
+    // Glides linearly towards new coefficients over numSteps calls to advanceCoefficients().
+    // Sections that aren't active right now have nothing to glide from, so they jump straight there.
+    void setTargetCoefficients(size_t index, const DesignedCoefficients& newCoefficients, int numSteps)
+    {
+        jassert(index < MaxSections);
+        
+        if (numSteps <= 0 || index >= numActiveSections)
+        {
+            setCoefficients(index, newCoefficients);
+            return;
+        }
+        
+        const auto& current = coefficients[index];
+        const auto& target = targetCoefficients[index] = newCoefficients.template withPrecision<SampleType>();
+        const auto steps = (SampleType)numSteps;
+        
+        increments[index] = { (target.b0 - current.b0) / steps,
+                              (target.b1 - current.b1) / steps,
+                              (target.b2 - current.b2) / steps,
+                              (target.a1 - current.a1) / steps,
+                              (target.a2 - current.a2) / steps };
+        stepsRemaining = numSteps;
+    }
+    
+    bool isSmoothing() const { return stepsRemaining > 0; }
+    
+    // Moves every gliding section one step closer to its target
+    void advanceCoefficients() noexcept
+    {
+        if (stepsRemaining <= 0)
+            return;
+        
+        // Land exactly on the targets at the end, rather than wherever the rounding errors took us
+        if (--stepsRemaining == 0)
+        {
+            coefficients = targetCoefficients;
+            return;
+        }
+        
+        for (size_t i = 0; i < MaxSections; i++)
+        {
+            auto& c = coefficients[i];
+            const auto& step = increments[i];
+            
+            c.b0 += step.b0;
+            c.b1 += step.b1;
+            c.b2 += step.b2;
+            c.a1 += step.a1;
+            c.a2 += step.a2;
+        }
+    }
+    
+    void setNumActiveSections(size_t newNumActiveSections)
+    {
+        jassert(newNumActiveSections <= MaxSections);
+        
+        // Sections that are switched back on start from silence rather than stale state
+        for (auto i = numActiveSections; i < newNumActiveSections; i++)
+            resetSection(i);
+        
+        numActiveSections = newNumActiveSections;
+    }
+    
+    size_t getNumActiveSections() const { return numActiveSections; }
+    
+    void reset()
+    {
+        for (size_t i = 0; i < MaxSections; i++)
+            resetSection(i);
+    }
+    
+    // Filters numSamples interleaved samples in place.
+    // Picks the instantiation for the number of active sections once per block.
+    void process(Register* samples, size_t numSamples) noexcept
+    {
+        processWithActiveSections<MaxSections>(samples, numSamples);
+    }
+private:
+    template<size_t NumSections>
+    void processWithActiveSections(Register* samples, size_t numSamples) noexcept
+    {
+        if (numActiveSections == NumSections)
+            processSections(std::make_index_sequence<NumSections>(), samples, numSamples);
+        else if constexpr (NumSections > 0)
+            processWithActiveSections<NumSections - 1>(samples, numSamples);
+    }
+    
+    template<size_t... Sections>
+    void processSections(std::index_sequence<Sections...>, Register* samples, size_t numSamples) noexcept
+    {
+        if constexpr (sizeof...(Sections) > 0)
+        {
+            // Copy everything into locals first, so it can stay in registers for the whole block
+            const Register b0[] { Register::expand(coefficients[Sections].b0)... };
+            const Register b1[] { Register::expand(coefficients[Sections].b1)... };
+            const Register b2[] { Register::expand(coefficients[Sections].b2)... };
+            const Register a1[] { Register::expand(coefficients[Sections].a1)... };
+            const Register a2[] { Register::expand(coefficients[Sections].a2)... };
+            Register z1[] { s1[Sections]... };
+            Register z2[] { s2[Sections]... };
+            
+            for (size_t n = 0; n < numSamples; n++)
+            {
+                auto x = samples[n];
+                // Expands to exactly one biquad per active section: no loop, no branches
+                ((x = processSample(x, b0[Sections], b1[Sections], b2[Sections], a1[Sections], a2[Sections],
+                                    z1[Sections], z2[Sections])), ...);
+                samples[n] = x;
+            }
+            
+            // Once per block is plenty to keep long tails from decaying into denormals
+            ((s1[Sections] = flushToZero(z1[Sections])), ...);
+            ((s2[Sections] = flushToZero(z2[Sections])), ...);
+        }
+        else
+        {
+            juce::ignoreUnused(samples, numSamples);
+        }
+    }
+    
+    // Transposed direct form II, same as juce::dsp::IIR::Filter
+    static Register processSample(Register x,
+                                  Register b0, Register b1, Register b2,
+                                  Register a1, Register a2,
+                                  Register& z1, Register& z2) noexcept
+    {
+        const auto y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return y;
+    }
+    
+    // State this small (-300 dB) is inaudible, but left alone it keeps shrinking until it's denormal,...
+    // ...which is slow everywhere ScopedNoDenormals can't help (e.g. doubles on some ARM hosts).
+    // So each lane gets set to exactly zero once it drops below this.
+    static constexpr SampleType stateFlushThreshold = (SampleType)1.0e-15;
+    
+    static Register flushToZero(Register state) noexcept
+    {
+        return state & Register::greaterThanOrEqual(Register::abs(state), Register::expand(stateFlushThreshold));
+    }
+    
+    void resetSection(size_t index)
+    {
+        s1[index] = Register::expand(0);
+        s2[index] = Register::expand(0);
+    }
+    
+    // Coefficients and state are each kept in one contiguous array
+    std::array<SectionCoefficients, MaxSections> coefficients;
+    std::array<Register, MaxSections> s1 {}, s2 {};
+    
+    // Coefficient smoothing: where each section is headed, and how far it moves per step
+    std::array<SectionCoefficients, MaxSections> targetCoefficients, increments;
+    int stepsRemaining {0};
+    
+    size_t numActiveSections {0};
+};
+
+// Log-spaced frequency table for evaluating biquad magnitude responses at many frequencies at once.
+// Everything that depends on the frequency alone is worked out once in prepare(), so each...
+// ...section only costs a few multiply-adds per frequency, with no trigonometry or branches.
+struct FrequencyResponseTable
+{
+    // Must be called off the audio thread, this allocates
+    void prepare(int newNumPoints, double minFrequency, double maxFrequency, double newSampleRate)
+    {
+        resize(newNumPoints, newSampleRate);
+        
+        for (size_t i = 0; i < phi.size(); i++)
+            setFrequency(i, juce::mapToLog10(double(i) / double(newNumPoints), minFrequency, maxFrequency));
+    }
+    
+    // Same as above, but spaced linearly from DC up to and including Nyquist (e.g. at every FFT bin)
+    void prepareLinear(int newNumPoints, double newSampleRate)
+    {
+        resize(newNumPoints, newSampleRate);
+        
+        for (size_t i = 0; i < phi.size(); i++)
+            setFrequency(i, 0.5 * sampleRate * double(i) / double(juce::jmax(1, newNumPoints - 1)));
+    }
+    
+    int getNumPoints() const { return (int)phi.size(); }
+    double getSampleRate() const { return sampleRate; }
+    
+    // Multiplies the squared magnitude response of one biquad into magnitudesSquared[]
+    void multiplySquaredMagnitudes(const DesignedCoefficients& c, double* magnitudesSquared) const noexcept
+    {
+        // |H|^2 = ((b0+b1+b2)^2 - phi (b0 b1 + b1 b2 + 4 b0 b2) + phi^2 b0 b2) / (same again for 1, a1, a2)
+        const double b0 = c.b0, b1 = c.b1, b2 = c.b2, a1 = c.a1, a2 = c.a2;
+        
+        const auto numerator0 = (b0 + b1 + b2) * (b0 + b1 + b2);
+        const auto numerator1 = -(b0 * b1 + b1 * b2 + 4.0 * b0 * b2);
+        const auto numerator2 = b0 * b2;
+        const auto denominator0 = (1.0 + a1 + a2) * (1.0 + a1 + a2);
+        const auto denominator1 = -(a1 + a1 * a2 + 4.0 * a2);
+        const auto denominator2 = a2;
+        
+        const auto* p = phi.data();
+        const auto* pSquared = phiSquared.data();
+        
+        for (size_t i = 0; i < phi.size(); i++)
+        {
+            auto numerator = numerator0 + numerator1 * p[i] + numerator2 * pSquared[i];
+            auto denominator = denominator0 + denominator1 * p[i] + denominator2 * pSquared[i];
+            magnitudesSquared[i] *= numerator / denominator;
+        }
+    }
+private:
+    void resize(int newNumPoints, double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        phi.resize((size_t)newNumPoints);
+        phiSquared.resize((size_t)newNumPoints);
+    }
+    
+    void setFrequency(size_t index, double frequency)
+    {
+        auto sinHalfOmega = std::sin(juce::MathConstants<double>::pi * frequency / sampleRate);
+        
+        // phi = 4 sin^2(w/2). Writing the response in terms of phi rather than cos(w) avoids...
+        // ...cancellation errors near DC, where cut filters have a lot of attenuation
+        phi[index] = 4.0 * sinHalfOmega * sinHalfOmega;
+        phiSquared[index] = phi[index] * phi[index];
+    }
+    
+    double sampleRate {0};
+    std::vector<double> phi, phiSquared;
+};
+
+// Converts a (planar) audio block to and from the interleaved layout the cascade works on
+template<typename SampleType>
+struct SIMDChannelInterleaver
+{
+    using Register = SIMDRegister<SampleType>;
+    static constexpr size_t numLanes = numSIMDLanes<SampleType>;
+    
+    // Must be called off the audio thread, this allocates
+    void prepare(int maximumBlockSize)
+    {
+        samples.assign((size_t)maximumBlockSize, Register::expand(0));
+    }
+
+    void interleave(const juce::dsp::AudioBlock<SampleType>& block) noexcept
+    {
+        const auto numChannels = juce::jmin(block.getNumChannels(), numLanes);
+        const auto numSamples = block.getNumSamples();
+        jassert(numSamples <= samples.size());
+
+        auto* interleaved = reinterpret_cast<SampleType*>(samples.data());
+
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            auto* channelData = block.getChannelPointer(channel);
+
+            for (size_t n = 0; n < numSamples; n++)
+                interleaved[n * numLanes + channel] = channelData[n];
+        }
+    }
+
+    void deinterleave(juce::dsp::AudioBlock<SampleType>& block) const noexcept
+    {
+        const auto numChannels = juce::jmin(block.getNumChannels(), numLanes);
+        const auto numSamples = block.getNumSamples();
+
+        auto* interleaved = reinterpret_cast<const SampleType*>(samples.data());
+
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            auto* channelData = block.getChannelPointer(channel);
+
+            for (size_t n = 0; n < numSamples; n++)
+                channelData[n] = interleaved[n * numLanes + channel];
+        }
+    }
+
+    Register* getData() noexcept { return samples.data(); }
+private:
+    std::vector<Register> samples;
+};
@@ -267,7 +267,8 @@ juce::String RotarySliderWithLabels::getDisplayString() const
 ResponseCurve::ResponseCurve(_3BandEQAudioProcessor& audioProcessor) :
 audioProcessor(audioProcessor),
 leftChannelPathGenerator(audioProcessor.leftChannelFIFO),
-rightChannelPathGenerator(audioProcessor.rightChannelFIFO)
+rightChannelPathGenerator(audioProcessor.rightChannelFIFO),
+analyzer(audioProcessor, leftChannelPathGenerator, rightChannelPathGenerator)
 {
     // Tell our Listener to listen to the main audio processor chain parameters
     const auto& parameters = audioProcessor.getParameters();
@@ -279,12 +280,22 @@ rightChannelPathGenerator(audioProcessor.rightChannelFIFO)
     // Update the response curve audio chain once to begin with
     updateChain();
     
+    // Match the analyzer button's current state. This also tells the audio thread...
+    // ...whether to start feeding the analyzer FIFOs
+    setFFTAnalysisEnabled(audioProcessor.APVTS.getRawParameterValue("Analyzer_Bypass")->load() > 0.5f);
+    
+    // We fill our whole area in paint(), so nothing behind us needs repainting when we do
+    setOpaque(true);
+    
     // Start the timer, update GUI at 60Hz refresh rate
     startTimerHz(60);
 }
 
 ResponseCurve::~ResponseCurve()
 {
+    // Make sure the analyzer workers are done with our path generators before they go away
+    analyzerService->removeStream(&analyzer);
+    
     // Tell our Listener to stop listening to the main audio processor chain parameters
     const auto& parameters = audioProcessor.getParameters();
     for (auto parameter : parameters)
@@ -293,205 +304,384 @@ ResponseCurve::~ResponseCurve()
     }
 }
 
+void ResponseCurve::setFFTAnalysisEnabled(bool b)
+{
+    isFFTAnalysisEnabled = b;
+    
+    // Only have the audio thread feed the analyzer while it is actually displayed
+    leftChannelPathGenerator.setActive(b);
+    rightChannelPathGenerator.setActive(b && analyzerUsesSecondTrace(analyzerChannels));
+    
+    // ...and only have the analyzer workers process it while it is, too
+    if (b)
+    {
+        analyzerService->addStream(&analyzer);
+    }
+    else
+    {
+        analyzerService->removeStream(&analyzer);
+        
+        // Clear the analyzer traces away once, then stop repainting for them
+        leftAnalyzerTrace.clear();
+        rightAnalyzerTrace.clear();
+        leftPeakTrace.clear();
+        rightPeakTrace.clear();
+        repaint(getRenderArea());
+    }
+}
+
 void ResponseCurve::parameterValueChanged(int parameterIndex, float newValue)
 {
     // raise our atomic flag
     parametersChanged.set(true);
 }
 
-void PathGenerator::process(juce::Rectangle<float> fftBounds, double sampleRate)
+void PathGenerator::setOrder(FFTOrder newOrder)
 {
-    // While there are buffers to pull,
-    // if we can pull a buffer,
-    // send it to the FFT data generator
-    juce::AudioBuffer<float> tempIncomingBuffer;
-    while ( leftChannelFIFO->getNumCompleteBuffersAvailable() > 0 )
+    order = newOrder;
+    leftChannelFFTDataGenerator.changeOrder(order);
+    // (setSize clears the buffer, so the new window starts from silence)
+    monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
+    
+    // The old history doesn't line up with the new bins, so start that over too
+    auto numBins = (size_t)leftChannelFFTDataGenerator.getFFTSize() / 2;
+    averagedData.assign(numBins, -48.f);
+    peakData.assign(numBins, -48.f);
+    peakHoldCounters.assign(numBins, 0);
+}
+
+void PathGenerator::setBallistics(float newAveragingTimeSeconds, PeakHold newPeakHold)
+{
+    averagingTimeSeconds = newAveragingTimeSeconds;
+    
+    // Switching peak hold modes clears the peaks that were held so far
+    if (newPeakHold != peakHold)
     {
-        if ( leftChannelFIFO->getAudioBuffer(tempIncomingBuffer) )
+        peakHold = newPeakHold;
+        std::fill(peakData.begin(), peakData.end(), -48.f);
+        std::fill(peakHoldCounters.begin(), peakHoldCounters.end(), 0);
+    }
+}
+
+void PathGenerator::updateBallistics(float averagingCoefficient, float decayPerHop, int holdHops) noexcept
+{
+    const auto& newestData = leftChannelFFTDataGenerator.getFFTData();
+    const auto numBins = averagedData.size();
+    
+    // Exponential averaging (a one-pole lowpass on every bin)
+    for (size_t i = 0; i < numBins; i++)
+    {
+        averagedData[i] = newestData[i] + averagingCoefficient * (averagedData[i] - newestData[i]);
+    }
+    
+    if (peakHold == PeakHold::off)
+        return;
+    
+    for (size_t i = 0; i < numBins; i++)
+    {
+        // New peaks get held for holdHops FFTs...
+        if (newestData[i] >= peakData[i])
         {
-            // Shift mono buffer over by the number of samples in tempIncomingBuffer
-            auto numIncomingSamples = tempIncomingBuffer.getNumSamples();
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, 0),
-                                              monoBuffer.getReadPointer(0, numIncomingSamples),
-                                              monoBuffer.getNumSamples() - numIncomingSamples);
-            
-            // Copy the samples from our tempIncomingBuffer to the end of our mono buffer
-            juce::FloatVectorOperations::copy(monoBuffer.getWritePointer(0, monoBuffer.getNumSamples() - numIncomingSamples),
-                                              tempIncomingBuffer.getReadPointer(0, 0),
-                                              numIncomingSamples);
-            
-            // Send mono buffer to FFT data generator
-            leftChannelFFTDataGenerator.produceFFTDataForRendering(monoBuffer, -48.f);
+            peakData[i] = newestData[i];
+            peakHoldCounters[i] = holdHops;
+        }
+        // ...and then start falling (unless we hold them forever)
+        else if (peakHold == PeakHold::decay)
+        {
+            if (peakHoldCounters[i] > 0)
+                peakHoldCounters[i]--;
+            else
+                peakData[i] = juce::jmax(peakData[i] - decayPerHop, -48.f);
         }
     }
+}
+
+void PathGenerator::process(juce::Rectangle<float> fftBounds, double sampleRate, int hopSize)
+{
+    if ( ! leftChannelFIFO->isPrepared() || fftBounds.isEmpty() )
+        return;
     
-    // If there are FFT data buffers to pull, and we can pull a buffer,
-    // generate a path
-    const auto fftSize = leftChannelFFTDataGenerator.getFFTSize();
+    const auto fftSize = monoBuffer.getNumSamples();
+    hopSize = juce::jlimit(1, fftSize, hopSize);
+    
+    // FFTs run every hopSize samples, however the host happens to split its blocks up.
+    // Whatever is left over waits in the FIFO until the next frame.
+    auto numHops = leftChannelFIFO->getNumSamplesAvailable() / hopSize;
+    
+    // Not a whole hop since the last FFT, so keep showing the last path
+    if ( numHops == 0 )
+        return;
+    
+    // If we fell behind, hops that would be shifted out of the window again before...
+    // ...we get to show them are skipped (whole hops, so the FFTs stay hopSize apart)
+    const auto maxHops = juce::jmax(1, fftSize / hopSize);
+    if ( numHops > maxHops )
+    {
+        leftChannelFIFO->readSamples((numHops - maxHops) * hopSize, [](const float*, int) {});
+        numHops = maxHops;
+    }
+    
+    // Ballistics are given in seconds, so work out what they come to per hop
+    const auto hopSeconds = (float)(hopSize / sampleRate);
+    const auto averagingCoefficient = averagingTimeSeconds > 0 ? std::exp(-hopSeconds / averagingTimeSeconds) : 0.f;
+    // Peaks are held for a second, then fall at 20 dB per second
+    const auto holdHops = juce::roundToInt(1.f / hopSeconds);
+    const auto decayPerHop = 20.f * hopSeconds;
+    
+    auto* monoData = monoBuffer.getWritePointer(0);
+    
+    for (int hop = 0; hop < numHops; hop++)
+    {
+        // Shift mono buffer over by one hop
+        std::copy(monoData + hopSize, monoData + fftSize, monoData);
+        
+        // Copy the new samples straight from the FIFO to the end of our mono buffer
+        auto* writePosition = monoData + fftSize - hopSize;
+        leftChannelFIFO->readSamples(hopSize, [&writePosition](const float* samples, int numSamples)
+        {
+            juce::FloatVectorOperations::copy(writePosition, samples, numSamples);
+            writePosition += numSamples;
+        });
+        
+        // Send mono buffer to FFT data generator (one FFT per hop)...
+        leftChannelFFTDataGenerator.produceFFTDataForRendering(monoBuffer, -48.f);
+        // ...and fold every one of them into the averages and peaks
+        updateBallistics(averagingCoefficient, decayPerHop, holdHops);
+    }
+    
+    // Only the newest averages make it onto the screen, so only generate a path for those
     // Bin width is...
     // 48000 samples per second / 2048 fft samples = 23 Hz
     const auto binWidth = sampleRate / (double)fftSize;
     
-    while (leftChannelFFTDataGenerator.getNumAvailableFFTDataBlocks() > 0)
+    pathGenerator.generatePath(averagedData,
+                               fftBounds,
+                               fftSize,
+                               binWidth,
+                               -48.f);
+    
+    if (peakHold != PeakHold::off)
     {
-        std::vector<float> fftData;
-        if (leftChannelFFTDataGenerator.getFFTData(fftData))
-        {
-            pathGenerator.generatePath(fftData,
+        peakPathGenerator.generatePath(peakData,
                                        fftBounds,
                                        fftSize,
                                        binWidth,
                                        -48.f);
-        }
     }
     
-    // While there are paths that can be pulled,
-    //  pull as many as we can
-    // Only display the most recent path
+    // Hand the most recent paths over to the GUI
+    auto& paths = pathBuffer.getWriteBuffer();
+    bool gotPath = false;
     while (pathGenerator.getNumPathsAvailable())
     {
-        pathGenerator.getPath(leftChannelFFTPath);
+        gotPath = pathGenerator.getPath(paths.trace) || gotPath;
     }
+    
+    paths.peaks.clear();
+    while (peakPathGenerator.getNumPathsAvailable())
+    {
+        peakPathGenerator.getPath(paths.peaks);
+    }
+    
+    if (gotPath)
+        pathBuffer.publish();
+}
+
+//==============================================================================
+
+ResponseCurveAnalyzer::ResponseCurveAnalyzer(_3BandEQAudioProcessor& processor,
+                                             PathGenerator& leftChannelPathGenerator,
+                                             PathGenerator& rightChannelPathGenerator) :
+audioProcessor(processor),
+leftPathGenerator(leftChannelPathGenerator),
+rightPathGenerator(rightChannelPathGenerator)
+{
+}
+
+void ResponseCurveAnalyzer::setAnalysisArea(juce::Rectangle<float> area)
+{
+    analysisArea.getWriteBuffer() = area;
+    analysisArea.publish();
+}
+
+void ResponseCurveAnalyzer::processFrame()
+{
+    // Pick up the latest analysis area, if the GUI has been resized
+    analysisArea.update();
+    
+    // Pick up the latest analyzer resolution. Parameter choices 0, 1, 2 are orders 11, 12, 13.
+    auto newOrder = static_cast<FFTOrder>(FFTOrder::ORDER_2048 + juce::roundToInt(resolution->load()));
+    if (newOrder != leftPathGenerator.getOrder())
+    {
+        leftPathGenerator.setOrder(newOrder);
+        rightPathGenerator.setOrder(newOrder);
+    }
+    
+    // Overlap choices 0%, 50%, 75% give a hop of the whole, half, or a quarter of the FFT size
+    auto fftSize = 1 << newOrder;
+    auto hopSize = fftSize >> juce::roundToInt(overlap->load());
+    
+    // Averaging choices are Off, Fast, Medium and Slow
+    static constexpr float averagingTimes[] { 0.f, 0.1f, 0.3f, 1.f };
+    auto averagingTime = averagingTimes[juce::jlimit(0, 3, juce::roundToInt(averaging->load()))];
+    // Peak hold choices line up with PathGenerator::PeakHold
+    auto peakHoldMode = static_cast<PathGenerator::PeakHold>(juce::jlimit(0, 2, juce::roundToInt(peakHold->load())));
+    leftPathGenerator.setBallistics(averagingTime, peakHoldMode);
+    rightPathGenerator.setBallistics(averagingTime, peakHoldMode);
+    
+    auto fftBounds = analysisArea.getReadBuffer();
+    auto sampleRate = audioProcessor.getSampleRate();
+    leftPathGenerator.process(fftBounds, sampleRate, hopSize);
+    // Mono and left-only modes only have one trace, so skip the second FFT altogether
+    if ( analyzerUsesSecondTrace(audioProcessor.getAnalyzerChannels()) )
+        rightPathGenerator.process(fftBounds, sampleRate, hopSize);
+}
+
+// Helper function to pick up new analyzer paths, if there are any, and move them into the analysis area.
+// Returns true if the traces changed and need repainting.
+static bool updateAnalyzerTrace(PathGenerator& pathGenerator,
+                                juce::Path& trace,
+                                juce::Path& peakTrace,
+                                juce::Rectangle<int> analysisArea)
+{
+    if (! pathGenerator.pullNewestPath())
+        return false;
+    
+    // Translate once here rather than on every paint
+    auto translation = juce::AffineTransform::translation(analysisArea.getX(), analysisArea.getY());
+    trace = pathGenerator.getPath();
+    trace.applyTransform(translation);
+    peakTrace = pathGenerator.getPeakPath();
+    peakTrace.applyTransform(translation);
+    return true;
 }
 
 void ResponseCurve::timerCallback()
 {
-    // If analyzer is NOT bypassed,
+    // Only repaint when one of our layers has actually changed...
+    // ...so an idle editor with the analyzer off doesn't repaint at all
+    bool needsRepaint = false;
+    
+    // If analyzer is NOT bypassed, pick up any new paths from the analyzer thread
     if ( isFFTAnalysisEnabled )
     {
-        auto fftBounds = getAnalysisArea().toFloat();
-        auto sampleRate = audioProcessor.getSampleRate();
-        leftChannelPathGenerator.process(fftBounds, sampleRate);
-        rightChannelPathGenerator.process(fftBounds, sampleRate);
+        // Start or stop feeding the second trace if the analyzer channel mode has changed
+        auto newAnalyzerChannels = audioProcessor.getAnalyzerChannels();
+        if (newAnalyzerChannels != analyzerChannels)
+        {
+            analyzerChannels = newAnalyzerChannels;
+            rightChannelPathGenerator.setActive(analyzerUsesSecondTrace(analyzerChannels));
+            
+            if (! analyzerUsesSecondTrace(analyzerChannels))
+            {
+                rightAnalyzerTrace.clear();
+                rightPeakTrace.clear();
+                needsRepaint = true;
+            }
+        }
+        
+        auto analysisArea = getAnalysisArea();
+        // (no short-circuiting, both channels need pulling)
+        needsRepaint |= updateAnalyzerTrace(leftChannelPathGenerator, leftAnalyzerTrace, leftPeakTrace, analysisArea);
+        needsRepaint |= updateAnalyzerTrace(rightChannelPathGenerator, rightAnalyzerTrace, rightPeakTrace, analysisArea);
     }
     
     // if parameters have been changed since the last timer tick...
-    // ...lower the flag and update the Editor mono chain
+    // ...lower the flag and update the Editor's response curve layer
     if (parametersChanged.compareAndSetBool(false, true))
     {
         // update the response curve's audio chain
         updateChain();
+        needsRepaint = true;
     }
     
-    repaint();
+    // The labels around the grid never change, so only the area inside the border is dirty
+    if (needsRepaint)
+        repaint(getRenderArea());
 }
 
 void ResponseCurve::updateChain()
 {
-    auto chainSettings = getChainSettings(audioProcessor.APVTS);
+    auto chainSettings = audioProcessor.getCurrentChainSettings();
+    // Draw the response of the chain as it's actually being run, oversampling included
+    chainSettings.oversamplingOrder = audioProcessor.getOversamplingOrder(chainSettings.linearPhase);
+    auto sampleRate = getDesignSampleRate(chainSettings, audioProcessor.getSampleRate());
     
-    // update bypass settings
-    monoChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypass);
-    monoChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypass);
-    monoChain.setBypassed<ChainPositions::Peak>(chainSettings.peakBypass);
-    // update peak filter
-    auto peakCoefficients = makePeakFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCoefficients(monoChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
-    // update low cut filter
-    auto lowCutCoefficients = makeLowCutFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCutFilter(monoChain.get<ChainPositions::LowCut>(), lowCutCoefficients, chainSettings.lowCutSlope);
-    // update high cut filter
-    auto highCutCoefficients = makeHighCutFilter(chainSettings, audioProcessor.getSampleRate());
-    updateCutFilter(monoChain.get<ChainPositions::HighCut>(), highCutCoefficients, chainSettings.highCutSlope);
+    // Nothing to design until the host has told us its sample rate
+    if (sampleRate > 0)
+        chainCoefficients = makeChainCoefficients(chainSettings, sampleRate);
+    
+    updateResponseCurve();
 }
 
-void ResponseCurve::paint (juce::Graphics& g)
+// Rebuilds the cached response curve. Only needed when parameters change or we get resized.
+void ResponseCurve::updateResponseCurve()
 {
     using namespace juce;
     
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll (Colours::tan);
-    
-    // Draw response curve area background grid
-    g.drawImage(background, getLocalBounds().toFloat());
-    
     auto responseArea = getAnalysisArea();
     auto width = responseArea.getWidth();
+    auto sampleRate = chainCoefficients.sampleRate;
     
-    auto& peakFilter = monoChain.get<ChainPositions::Peak>();
-    auto& lowCutFilter = monoChain.get<ChainPositions::LowCut>();
-    auto& highCutFilter = monoChain.get<ChainPositions::HighCut>();
+    responseCurvePath.clear();
     
-    auto sampleRate = audioProcessor.getSampleRate();
+    if (width <= 0 || sampleRate <= 0)
+        return;
     
-    // Magnitudes as doubles representing Gain (multiplicative)
-    std::vector<double> magnitudes;
-    // One magnitude value per pixel within response area width
-    magnitudes.resize(width);
-    // Calculate the magnitude at each pixel
-    for (int i=0; i<width; i++)
-    {
-        // calculate corresponding frequency for this pixel
-        auto freq = mapToLog10(double(i) / double(width), 20.0, 20000.0);
-        
-        // start with unity gain
-        double magnitude = 1.f;
-        // multiply the magnitude value by the resulting gain at this frequency...
-        // ...from each non-bypassed filter in our processing chain
-        // Peak Filter
-        if (! monoChain.isBypassed<ChainPositions::Peak>())
-            magnitude *= peakFilter.coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        // Low Cut Filter
-        if (! monoChain.isBypassed<ChainPositions::LowCut>() )
-        {
-            if (! lowCutFilter.isBypassed<0>())
-                magnitude *= lowCutFilter.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! lowCutFilter.isBypassed<1>())
-                magnitude *= lowCutFilter.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! lowCutFilter.isBypassed<2>())
-                magnitude *= lowCutFilter.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! lowCutFilter.isBypassed<3>())
-                magnitude *= lowCutFilter.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        }
-        // High Cut Filter
-        if (! monoChain.isBypassed<ChainPositions::HighCut>() )
-        {
-            if (! highCutFilter.isBypassed<0>())
-                magnitude *= highCutFilter.get<0>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! highCutFilter.isBypassed<1>())
-                magnitude *= highCutFilter.get<1>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! highCutFilter.isBypassed<2>())
-                magnitude *= highCutFilter.get<2>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-            if (! highCutFilter.isBypassed<3>())
-                magnitude *= highCutFilter.get<3>().coefficients->getMagnitudeForFrequency(freq, sampleRate);
-        }
-        
-        // Convert gain to decibels
-        magnitudes[i] = Decibels::gainToDecibels(magnitude);
-    }
+    // One table entry per pixel within response area width
+    if (responseTable.getNumPoints() != width || responseTable.getSampleRate() != sampleRate)
+        responseTable.prepare(width, 20.0, 20000.0, sampleRate);
     
-    // Draw our response curve
-    Path responseCurve;
+    // Magnitudes as SQUARED gain values, starting from unity gain...
+    magnitudes.assign((size_t)width, 1.0);
+    
+    // ...then multiplied by the response of each non-bypassed filter in our processing chain
+    multiplyChainSquaredMagnitudes(chainCoefficients, responseTable, magnitudes.data());
     
     const double yMin = responseArea.getBottom();
     const double yMax = responseArea.getY();
-    // converts decibels to screen coordinates
-    auto map = [yMin, yMax](double input)
+    // converts squared gain to decibels, then decibels to screen coordinates
+    auto map = [yMin, yMax](double magnitudeSquared)
     {
-        return jmap(input, -24.0, 24.0, yMin, yMax);
+        auto decibels = magnitudeSquared > 0 ? jmax(10.0 * std::log10(magnitudeSquared), -100.0) : -100.0;
+        return jmap(decibels, -24.0, 24.0, yMin, yMax);
     };
     
-    // Draw response curve
-    responseCurve.startNewSubPath( responseArea.getX(), map(magnitudes.front()) );
+    // Build response curve
+    responseCurvePath.preallocateSpace(3 * width);
+    responseCurvePath.startNewSubPath( responseArea.getX(), map(magnitudes.front()) );
     
     for (size_t i = 1; i < magnitudes.size(); i++)
     {
-        responseCurve.lineTo( responseArea.getX() + i, map(magnitudes[i]) );
+        responseCurvePath.lineTo( responseArea.getX() + i, map(magnitudes[i]) );
     }
+}
+
+void ResponseCurve::paint (juce::Graphics& g)
+{
+    using namespace juce;
     
-    // If analyzer is NOT bypassed, draw the FFT analysis curve
+    // (Our component is opaque, so we must completely fill the background with a solid colour)
+    g.fillAll (Colours::tan);
+    
+    // Draw response curve area background grid
+    g.drawImage(background, getLocalBounds().toFloat());
+    
+    // If analyzer is NOT bypassed, draw the FFT analysis curve.
+    // (the traces are already in our coordinates, see timerCallback)
     if ( isFFTAnalysisEnabled )
     {
         // Draw left channel FFT analyzer path
-        auto leftChannelFFTPath = leftChannelPathGenerator.getPath();
-        leftChannelFFTPath.applyTransform(AffineTransform().translation(responseArea.getX(), responseArea.getY()));
         g.setColour(Colours::brown);
-        g.strokePath(leftChannelFFTPath, PathStrokeType(1.f));
+        g.strokePath(leftAnalyzerTrace, PathStrokeType(1.f));
         // Draw right channel FFT analyzer path
-        auto rightChannelFFTPath = rightChannelPathGenerator.getPath();
-        rightChannelFFTPath.applyTransform(AffineTransform().translation(responseArea.getX(), responseArea.getY()));
         g.setColour(Colours::maroon);
-        g.strokePath(rightChannelFFTPath, PathStrokeType(1.f));
+        g.strokePath(rightAnalyzerTrace, PathStrokeType(1.f));
+        // Draw peak hold paths (empty unless peak hold is on), fainter than the traces
+        g.setColour(Colours::brown.withAlpha(0.5f));
+        g.strokePath(leftPeakTrace, PathStrokeType(1.f));
+        g.setColour(Colours::maroon.withAlpha(0.5f));
+        g.strokePath(rightPeakTrace, PathStrokeType(1.f));
     }
 
     // draw rounded rectangle border.
@@ -502,7 +692,7 @@ void ResponseCurve::paint (juce::Graphics& g)
     // draw response path
     // second argument is line thickness
     g.setColour(Colours::white);
-    g.strokePath(responseCurve, PathStrokeType(2.f));
+    g.strokePath(responseCurvePath, PathStrokeType(2.f));
 }
 
 // Called when plugin is resized, and BEFORE paint.
@@ -510,6 +700,9 @@ void ResponseCurve::resized()
 {
     using namespace juce;
     
+    // Let the analyzer thread know where its paths will be drawn
+    analyzer.setAnalysisArea(getAnalysisArea().toFloat());
+    
     background = Image(Image::PixelFormat::RGB, getWidth(), getHeight(), true);
     Graphics g(background);
     
@@ -627,6 +820,9 @@ void ResponseCurve::resized()
         g.setColour( gain == 0.f ? Colour(0u, 150u, 0u) : Colours::darkgrey );
         g.drawFittedText(str, rect, juce::Justification::centred, 1);
     }
+    
+    // The response curve is cached per pixel, so it needs rebuilding for the new size
+    updateResponseCurve();
 }
 
 juce::Rectangle<int> ResponseCurve::getRenderArea()
@@ -651,6 +847,31 @@ juce::Rectangle<int> ResponseCurve::getAnalysisArea()
     return bounds;
 }
 
+void ProcessingStatsDisplay::timerCallback()
+{
+    auto newText = audioProcessor.getProcessingStats().toString();
+    
+    // Only repaint when something has actually changed
+    if (newText != text)
+    {
+        text = newText;
+        repaint();
+    }
+}
+
+void ProcessingStatsDisplay::paint(juce::Graphics& g)
+{
+    g.setColour(juce::Colours::black.withAlpha(0.6f));
+    g.setFont(12);
+    g.drawFittedText(text, getLocalBounds(), juce::Justification::centredRight, 1);
+}
+
+void ProcessingStatsDisplay::mouseDown(const juce::MouseEvent&)
+{
+    audioProcessor.resetProcessingStats();
+    timerCallback();
+}
+
 //==============================================================================
 //  Class Definition
 //==============================================================================
@@ -668,17 +889,15 @@ lowCutSlopeSlider(*audioProcessor.APVTS.getParameter("LowCut_Slope"), "dB/oct"),
 highCutFreqSlider(*audioProcessor.APVTS.getParameter("HighCut_Freq"), "Hz"),
 highCutSlopeSlider(*audioProcessor.APVTS.getParameter("HighCut_Slope"), "dB/oct"),
 
-peakFreqSliderAttachment(audioProcessor.APVTS, "Peak_Freq", peakFreqSlider),
-peakGainSliderAttachment(audioProcessor.APVTS, "Peak_Gain", peakGainSlider),
-peakQSliderAttachment(audioProcessor.APVTS, "Peak_Q", peakQSlider),
 lowCutFreqSliderAttachment(audioProcessor.APVTS, "LowCut_Freq", lowCutFreqSlider),
 lowCutSlopeSliderAttachment(audioProcessor.APVTS, "LowCut_Slope", lowCutSlopeSlider),
 highCutFreqSliderAttachment(audioProcessor.APVTS, "HighCut_Freq", highCutFreqSlider),
 highCutSlopeSliderAttachment(audioProcessor.APVTS, "HighCut_Slope", highCutSlopeSlider),
 
+processingStatsDisplay(audioProcessor),
+
 lowCutBypassButtonAttachment(audioProcessor.APVTS, "LowCut_Bypass", lowCutBypassButton),
 highCutBypassButtonAttachment(audioProcessor.APVTS, "HighCut_Bypass", highCutBypassButton),
-peakBypassButtonAttachment(audioProcessor.APVTS, "Peak_Bypass", peakBypassButton),
 analyzerBypassButtonAttachment(audioProcessor.APVTS, "Analyzer_Bypass", analyzerBypassButton)
 {
     // Define min/max value labels for our rotary sliders
@@ -738,8 +957,23 @@ analyzerBypassButtonAttachment(audioProcessor.APVTS, "Analyzer_Bypass", analyzer
             juceComp->peakFreqSlider.setEnabled( !bypassed );
             juceComp->peakGainSlider.setEnabled( !bypassed );
             juceComp->peakQSlider.setEnabled( !bypassed );
+            juceComp->peakTypeSelector.setEnabled( !bypassed );
         }
     };
+    // Band selector: the peak controls show one band at a time
+    for (int band = 0; band < maxNumBands; band++)
+        peakBandSelector.addItem("Band " + juce::String(band + 1), band + 1);
+    peakBandSelector.onChange = [safePtr]()
+    {
+        if ( auto* juceComp = safePtr.getComponent() )
+            juceComp->selectBand( juceComp->peakBandSelector.getSelectedItemIndex() );
+    };
+    // Every band has the same filter types, so the first band's parameter has the list for all of them
+    if (auto* typeParameter = dynamic_cast<juce::AudioParameterChoice*>(audioProcessor.APVTS.getParameter(getBandParameterID(0, "Type"))))
+        peakTypeSelector.addItemList(typeParameter->choices, 1);
+    
+    peakBandSelector.setSelectedItemIndex(0, juce::dontSendNotification);
+    selectBand(0);
     // Same thing for analyzer
     analyzerBypassButton.onClick = [safePtr]()
     {
@@ -772,6 +1006,37 @@ void _3BandEQAudioProcessorEditor::paint (juce::Graphics& g)
     g.fillAll (Colours::tan);
 }
 
+// Points the peak sliders, bypass button and type selector at another band's parameters
+void _3BandEQAudioProcessorEditor::selectBand(int band)
+{
+    band = juce::jlimit(0, maxNumBands - 1, band);
+    auto& apvts = audioProcessor.APVTS;
+    
+    // The old attachments have to let go of the controls before the new ones take them over
+    peakFreqSliderAttachment.reset();
+    peakGainSliderAttachment.reset();
+    peakQSliderAttachment.reset();
+    peakBypassButtonAttachment.reset();
+    peakTypeSelectorAttachment.reset();
+    
+    // (So the sliders' value labels come from the band they're showing)
+    peakFreqSlider.setParameter(*apvts.getParameter(getBandParameterID(band, "Freq")));
+    peakGainSlider.setParameter(*apvts.getParameter(getBandParameterID(band, "Gain")));
+    peakQSlider.setParameter(*apvts.getParameter(getBandParameterID(band, "Q")));
+    
+    // Each of these sets its control to the new band's value as it's made
+    peakFreqSliderAttachment = std::make_unique<Attachment>(apvts, getBandParameterID(band, "Freq"), peakFreqSlider);
+    peakGainSliderAttachment = std::make_unique<Attachment>(apvts, getBandParameterID(band, "Gain"), peakGainSlider);
+    peakQSliderAttachment = std::make_unique<Attachment>(apvts, getBandParameterID(band, "Q"), peakQSlider);
+    peakBypassButtonAttachment = std::make_unique<ButtonAttachment>(apvts, getBandParameterID(band, "Bypass"), peakBypassButton);
+    peakTypeSelectorAttachment = std::make_unique<ComboBoxAttachment>(apvts, getBandParameterID(band, "Type"), peakTypeSelector);
+    
+    // The bypass button only calls this when its state actually changes, and the new band's...
+    // ...bypass might be the same as the old one's, so enable or disable its controls here too
+    if (peakBypassButton.onClick)
+        peakBypassButton.onClick();
+}
+
 // GUI bounds/sizing methods
 void _3BandEQAudioProcessorEditor::resized()
 {
@@ -781,6 +1046,7 @@ void _3BandEQAudioProcessorEditor::resized()
     auto bounds = getLocalBounds();
     
     auto analyzerBypassArea = bounds.removeFromTop(25);
+    processingStatsDisplay.setBounds(analyzerBypassArea.withTrimmedLeft(110).withTrimmedRight(5));
     analyzerBypassArea.setWidth(100);
     analyzerBypassArea.setX(5);
     analyzerBypassArea.removeFromTop(2);
@@ -807,6 +1073,9 @@ void _3BandEQAudioProcessorEditor::resized()
     highCutSlopeSlider.setBounds(highCutArea);
     
     peakBypassButton.setBounds(bounds.removeFromTop(25));
+    auto peakSelectorArea = bounds.removeFromTop(22).reduced(2, 0);
+    peakBandSelector.setBounds(peakSelectorArea.removeFromLeft(peakSelectorArea.getWidth() / 2).withTrimmedRight(2));
+    peakTypeSelector.setBounds(peakSelectorArea.withTrimmedLeft(2));
     peakFreqSlider.setBounds(bounds.removeFromTop(bounds.getHeight() * 0.33));
     peakGainSlider.setBounds(bounds.removeFromTop(bounds.getHeight() * 0.5));
     peakQSlider.setBounds(bounds);
@@ -830,6 +1099,11 @@ std::vector<juce::Component*> _3BandEQAudioProcessorEditor::getComponents()
         &lowCutBypassButton,
         &highCutBypassButton,
         &peakBypassButton,
-        &analyzerBypassButton
+        &analyzerBypassButton,
+        
+        &peakBandSelector,
+        &peakTypeSelector,
+        
+        &processingStatsDisplay
     };
 }
@@ -10,13 +10,35 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "AnalyzerService.h"
 
-enum FFTOrder
+#include <cstring>
+
+// Helper function to scale gain values and convert them to decibels in place, in a single pass.
+// Uses a fast log2 approximation (within 0.01 dB, plenty for drawing) with no branches or...
+// ...library calls in the loop, so the compiler can vectorize the whole thing.
+inline void scaledGainsToDecibels(float* data, int numValues, float scale, float minusInfinityDb) noexcept
 {
-    ORDER_2048 = 11,
-    ORDER_4096 = 12,
-    ORDER_8192 = 13
-};
+    // 20 log10(x) == 20 log10(2) * log2(x)
+    constexpr float decibelsPerOctave = 6.0206f;
+    
+    for (int i = 0; i < numValues; i++)
+    {
+        // Split x into 2^exponent * (1 + t), with t between 0 and 1
+        const float x = data[i] * scale;
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        const auto exponent = (float)((int)(bits >> 23) - 127);
+        bits = (bits & 0x007fffffu) | 0x3f800000u;
+        float mantissa;
+        std::memcpy(&mantissa, &bits, sizeof(mantissa));
+        const auto t = mantissa - 1.f;
+        
+        // Cubic fit of log2(1 + t). Zero comes out at around -764 dB, so the clamp takes care of it.
+        const auto log2x = exponent + t * (1.4234902f + t * (-0.58775347f + t * 0.16557608f));
+        data[i] = juce::jmax(log2x * decibelsPerOctave, minusInfinityDb);
+    }
+}
 
 // This class generates FFT data from an audio buffer
 template<typename BlockType>
@@ -26,61 +48,45 @@ struct FFTDataGenerator
     {
         const auto fftSize = getFFTSize();
         
-        fftData.assign(fftData.size(), 0);
+        // The first half gets overwritten by the new samples, so only the FFT's working space needs clearing
         auto* readIndex = audioData.getReadPointer(0);
         std::copy(readIndex, readIndex + fftSize, fftData.begin());
+        juce::FloatVectorOperations::clear(fftData.data() + fftSize, fftSize);
         
         // First apply a windowing function to our data
-        window->multiplyWithWindowingTable( fftData.data(), fftSize );
+        fftResources->window.multiplyWithWindowingTable( fftData.data(), fftSize );
         // then render our FFT data
-        forwardFFT->performFrequencyOnlyForwardTransform( fftData.data() );
+        fftResources->forwardFFT.performFrequencyOnlyForwardTransform( fftData.data() );
         
         int numBins = (int)fftSize / 2;
         
-        // Normalize FFT values
-        for (int i=0; i<numBins; i++)
-        {
-            fftData[i] /= (float)numBins;
-        }
-        
-        // Convert the FFT values to dB
-        for (int i=0; i<numBins; i++)
-        {
-            fftData[i] = juce::Decibels::gainToDecibels(fftData[i], negativeInf);
-        }
-        
-        fftDataFIFO.push(fftData);
+        // Normalize FFT values and convert them to dB
+        scaledGainsToDecibels(fftData.data(), numBins, 1.f / (float)numBins, negativeInf);
     }
     
     void changeOrder(FFTOrder newOrder)
     {
-        // When FFT order is changed, recreate the window, forwardFFT, fifo, fftData
-        // and reset the fifoIndex
-        // Things that need recreating should be created on the heap via std::make_unique<>
+        // When FFT order is changed, grab the window and forwardFFT for the new order,
+        // and recreate fftData.
+        // The window and forwardFFT are shared between every analyzer using the same order.
         order = newOrder;
         auto fftSize = getFFTSize();
         
-        forwardFFT = std::make_unique<juce::dsp::FFT>(order);
-        window = std::make_unique<juce::dsp::WindowingFunction<float>>(fftSize,
-                                                                       juce::dsp::WindowingFunction<float>::blackmanHarris);
+        fftResources = FFTResources::getShared(order);
         
         fftData.clear();
         fftData.resize(fftSize * 2, 0);
-        
-        fftDataFIFO.prepare(fftData.size());
     }
     //======================================================================================
     int getFFTSize() const { return 1 << order; }
-    int getNumAvailableFFTDataBlocks() const { return fftDataFIFO.getNumAvailableForReading(); }
     //======================================================================================
-    bool getFFTData(BlockType& fftData) { return fftDataFIFO.pull(fftData); }
+    // The dB values of the newest FFT, read in place (only the first getFFTSize() / 2 are bins).
+    // Producing and drawing happen on the same analyzer thread, so there's nothing to hand over.
+    const BlockType& getFFTData() const { return fftData; }
 private:
     FFTOrder order;
     BlockType fftData;
-    std::unique_ptr<juce::dsp::FFT> forwardFFT;
-    std::unique_ptr<juce::dsp::WindowingFunction<float>> window;
-    
-    Fifo<BlockType> fftDataFIFO;
+    std::shared_ptr<FFTResources> fftResources;
 };
 
 // Generates a path from FFT data
@@ -98,10 +104,10 @@ struct AnalyzerPathGenerator
         auto bottom = fftBounds.getHeight();
         auto width = fftBounds.getWidth();
         
-        int numBins = (int)fftSize / 2;
+        updateBinMap(width, fftSize, binWidth);
         
         PathType p;
-        p.preallocateSpace( 3 * (int)fftBounds.getWidth() );
+        p.preallocateSpace( 3 * ((int)columns.size() + 1) );
         
         auto map = [bottom, top, negativeInf](float v)
         {
@@ -116,21 +122,18 @@ struct AnalyzerPathGenerator
         
         p.startNewSubPath(0, y);
         
-        // Draw line-to's every pathResolution pixels
-        const int pathResolution = 2;
-        
-        for ( int binNum = 1; binNum < numBins; binNum += pathResolution )
+        // Draw one line-to per pixel column, at the loudest bin that lands in it
+        for ( const auto& column : columns )
         {
-            y = map(renderData[binNum]);
+            auto peak = *std::max_element(renderData.begin() + column.firstBin,
+                                          renderData.begin() + column.lastBin);
+            y = map(peak);
             
             //jassert( !std::isnan(y) && !std::isinf(y) );
             
             if ( !std::isnan(y) && !std::isinf(y) )
             {
-                auto binFreq = binNum * binWidth;
-                auto normalizedBinX = juce::mapFromLog10(binFreq, 20.f, 20000.f);
-                int binX = std::floor(normalizedBinX * width);
-                p.lineTo(binX, y);
+                p.lineTo(column.x, y);
             }
         }
         
@@ -147,6 +150,46 @@ struct AnalyzerPathGenerator
         return pathFIFO.pull(path);
     }
 private:
+    // The bins [firstBin, lastBin) that all land in the pixel column at x
+    struct Column
+    {
+        float x;
+        int firstBin, lastBin;
+    };
+    
+    // Helper function to work out which bins land in which pixel column.
+    // Above a few hundred Hz, lots of bins share a column, so this limits the path to one...
+    // ...vertex per column. Only rebuilt when the width, FFT size or sample rate change.
+    void updateBinMap(float width, int fftSize, float binWidth)
+    {
+        if ( width == mappedWidth && fftSize == mappedFFTSize && binWidth == mappedBinWidth )
+            return;
+        
+        mappedWidth = width;
+        mappedFFTSize = fftSize;
+        mappedBinWidth = binWidth;
+        
+        columns.clear();
+        
+        int numBins = (int)fftSize / 2;
+        for ( int binNum = 1; binNum < numBins; binNum++ )
+        {
+            auto binFreq = binNum * binWidth;
+            auto normalizedBinX = juce::mapFromLog10(binFreq, 20.f, 20000.f);
+            auto binX = std::floor(normalizedBinX * width);
+            
+            // Consecutive bins in the same column get merged into one
+            if ( ! columns.empty() && columns.back().x == binX )
+                columns.back().lastBin = binNum + 1;
+            else
+                columns.push_back({ binX, binNum, binNum + 1 });
+        }
+    }
+    
+    std::vector<Column> columns;
+    float mappedWidth {0}, mappedBinWidth {0};
+    int mappedFFTSize {0};
+    
     Fifo<PathType> pathFIFO;
 };
 
@@ -192,6 +235,9 @@ struct RotarySliderWithLabels : juce::Slider
     
     juce::Array<LabelWithPosition> labels;
     
+    // Points this slider at another parameter with the same range (e.g. another band's)
+    void setParameter(juce::RangedAudioParameter& newParameter) { rap = &newParameter; repaint(); }
+    
     void paint(juce::Graphics& g) override;
     juce::Rectangle<int> getSliderBounds() const;
     int getTextHeight() const { return 14; }
@@ -210,23 +256,92 @@ struct PathGenerator
     PathGenerator(SingleChannelSampleFifo<_3BandEQAudioProcessor::BlockType>& scsf) :
     leftChannelFIFO(&scsf)
     {
-        leftChannelFFTDataGenerator.changeOrder(FFTOrder::ORDER_2048);
-        monoBuffer.setSize(1, leftChannelFFTDataGenerator.getFFTSize());
+        setOrder(FFTOrder::ORDER_2048);
     }
     
-    void process(juce::Rectangle<float> fftBounds, double sampleRate);
-
-    juce::Path getPath() { return leftChannelFFTPath; }
+    ~PathGenerator()
+    {
+        // Stop the audio thread from filling a FIFO that nobody reads anymore
+        setActive(false);
+    }
+    
+    // Tells the audio thread whether it should keep feeding our FIFO
+    void setActive(bool shouldBeActive) { leftChannelFIFO->setConsumerAttached(shouldBeActive); }
+    
+    // Called from the analyzer thread. Changes the FFT size, starting over with an empty window.
+    void setOrder(FFTOrder newOrder);
+    FFTOrder getOrder() const { return order; }
+    
+    enum class PeakHold
+    {
+        off,
+        decay,      // Peaks are held for a moment, then fall back down
+        infinite    // Peaks stay until the mode changes
+    };
+    
+    // Called from the analyzer thread. An averaging time of 0 shows every FFT as it is.
+    void setBallistics(float newAveragingTimeSeconds, PeakHold newPeakHold);
+    
+    // Called from the analyzer thread: runs one FFT every hopSize samples...
+    // ...and turns the newest one into a new path for the GUI
+    void process(juce::Rectangle<float> fftBounds, double sampleRate, int hopSize);
+    
+    // Called from the GUI: returns true if a new path has arrived since the last call
+    bool pullNewestPath() { return pathBuffer.update(); }
+    juce::Path getPath() const { return pathBuffer.getReadBuffer().trace; }
+    // Empty unless peak hold is on
+    juce::Path getPeakPath() const { return pathBuffer.getReadBuffer().peaks; }
 private:
+    // Updates the averaged and held spectra in place with the newest FFT
+    void updateBallistics(float averagingCoefficient, float decayPerHop, int holdHops) noexcept;
+    
     SingleChannelSampleFifo<_3BandEQAudioProcessor::BlockType>* leftChannelFIFO;
     
+    FFTOrder order {FFTOrder::ORDER_2048};
     juce::AudioBuffer<float> monoBuffer;
     
     FFTDataGenerator<std::vector<float>> leftChannelFFTDataGenerator;
     
-    AnalyzerPathGenerator<juce::Path> pathGenerator;
+    // Display ballistics, with one value per bin. Only resized when the FFT order changes.
+    float averagingTimeSeconds {0};
+    PeakHold peakHold {PeakHold::off};
+    std::vector<float> averagedData, peakData;
+    std::vector<int> peakHoldCounters;
+    
+    AnalyzerPathGenerator<juce::Path> pathGenerator, peakPathGenerator;
+    
+    struct Paths
+    {
+        juce::Path trace, peaks;
+    };
+    
+    // Finished paths, handed from the analyzer thread to the GUI
+    TripleBuffer<Paths> pathBuffer;
+};
+
+// The response curve's analyzer work: runs its path generators once per frame,...
+// ...on one of the shared AnalyzerService worker threads
+struct ResponseCurveAnalyzer : AnalyzerStream
+{
+    ResponseCurveAnalyzer(_3BandEQAudioProcessor& processor,
+                          PathGenerator& leftChannelPathGenerator,
+                          PathGenerator& rightChannelPathGenerator);
+    
+    // Called from the GUI whenever the analysis area changes size
+    void setAnalysisArea(juce::Rectangle<float> area);
+    
+    void processFrame() override;
+private:
+    _3BandEQAudioProcessor& audioProcessor;
+    PathGenerator &leftPathGenerator, &rightPathGenerator;
+    
+    // Analyzer settings, read once per frame
+    std::atomic<float>* resolution {audioProcessor.APVTS.getRawParameterValue("Analyzer_Resolution")};
+    std::atomic<float>* overlap {audioProcessor.APVTS.getRawParameterValue("Analyzer_Overlap")};
+    std::atomic<float>* averaging {audioProcessor.APVTS.getRawParameterValue("Analyzer_Averaging")};
+    std::atomic<float>* peakHold {audioProcessor.APVTS.getRawParameterValue("Analyzer_Peak_Hold")};
     
-    juce::Path leftChannelFFTPath;
+    TripleBuffer<juce::Rectangle<float>> analysisArea;
 };
 
 // Response Curve struct
@@ -243,7 +358,7 @@ juce::Timer
     
     void timerCallback() override;
     
-    void setFFTAnalysisEnabled(bool b) { isFFTAnalysisEnabled = b; }
+    void setFFTAnalysisEnabled(bool b);
     
     void paint(juce::Graphics& g) override;
     void resized() override;
@@ -254,17 +369,44 @@ private:
     // atomic flag to let us know when our parameters have changed...
     // ...and the GUI needs updating
     juce::Atomic<bool> parametersChanged {false};
-    // Mono chain
-    MonoChain monoChain;
+    // Coefficients of the processor's filter chain, redesigned whenever parameters change
+    ChainCoefficients chainCoefficients;
     void updateChain();
-    // Response curve grid background
+    // Cached response curve, rebuilt only when parameters change or we get resized
+    FrequencyResponseTable responseTable;
+    std::vector<double> magnitudes;
+    juce::Path responseCurvePath;
+    void updateResponseCurve();
+    // Response curve grid background, only redrawn when we get resized
     juce::Image background;
     juce::Rectangle<int> getRenderArea();
     juce::Rectangle<int> getAnalysisArea();
     // Path generator
     PathGenerator leftChannelPathGenerator, rightChannelPathGenerator;
+    // Feeds the path generators from the shared analyzer worker threads
+    ResponseCurveAnalyzer analyzer;
+    juce::SharedResourcePointer<AnalyzerService> analyzerService;
+    // Newest analyzer paths, already moved into the analysis area, only replaced when new ones arrive
+    juce::Path leftAnalyzerTrace, rightAnalyzerTrace;
+    juce::Path leftPeakTrace, rightPeakTrace;
     
     bool isFFTAnalysisEnabled {true};
+    AnalyzerChannels analyzerChannels {audioProcessor.getAnalyzerChannels()};
+};
+
+// One line of this instance's audio thread statistics, refreshed a few times a second.
+// Clicking it starts the statistics over.
+struct ProcessingStatsDisplay : juce::Component,
+juce::Timer
+{
+    ProcessingStatsDisplay(_3BandEQAudioProcessor& p) : audioProcessor(p) { startTimerHz(4); }
+    
+    void timerCallback() override;
+    void paint(juce::Graphics& g) override;
+    void mouseDown(const juce::MouseEvent&) override;
+private:
+    _3BandEQAudioProcessor& audioProcessor;
+    juce::String text;
 };
 
 struct PowerButton : juce::ToggleButton {  };
@@ -330,10 +472,7 @@ private:
     // Declare parameter attachments for each of our sliders
     using APVTS = juce::AudioProcessorValueTreeState;
     using Attachment = APVTS::SliderAttachment;
-    Attachment peakFreqSliderAttachment,
-               peakGainSliderAttachment,
-               peakQSliderAttachment,
-               lowCutFreqSliderAttachment,
+    Attachment lowCutFreqSliderAttachment,
                lowCutSlopeSliderAttachment,
                highCutFreqSliderAttachment,
                highCutSlopeSliderAttachment;
@@ -344,13 +483,28 @@ private:
                 peakBypassButton;
     AnalyzerButton analyzerBypassButton;
     
+    // Which band the peak controls are showing, and that band's filter type
+    juce::ComboBox peakBandSelector,
+                   peakTypeSelector;
+    
+    ProcessingStatsDisplay processingStatsDisplay;
+    
     // Bypass toggle button attachments for each of our buttons
     using ButtonAttachment = APVTS::ButtonAttachment;
     ButtonAttachment lowCutBypassButtonAttachment,
                      highCutBypassButtonAttachment,
-                     peakBypassButtonAttachment,
                      analyzerBypassButtonAttachment;
     
+    // The peak controls follow whichever band is selected, so their attachments...
+    // ...get made again every time the selection changes (see selectBand())
+    using ComboBoxAttachment = APVTS::ComboBoxAttachment;
+    std::unique_ptr<Attachment> peakFreqSliderAttachment,
+                                peakGainSliderAttachment,
+                                peakQSliderAttachment;
+    std::unique_ptr<ButtonAttachment> peakBypassButtonAttachment;
+    std::unique_ptr<ComboBoxAttachment> peakTypeSelectorAttachment;
+    void selectBand(int band);
+    
     LookAndFeel lookAndFeel;
     
     // Declare a function to return all our rotary sliders and buttons as a vector
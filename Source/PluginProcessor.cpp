@@ -63,7 +63,7 @@ bool _3BandEQAudioProcessor::isMidiEffect() const
 
 double _3BandEQAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return tailLengthSeconds.load();
 }
 
 int _3BandEQAudioProcessor::getNumPrograms()
@@ -95,6 +95,16 @@ void _3BandEQAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    
+    // The analyzer rings are the biggest things we own that aren't needed to play again...
+    // ...(the chains and the convolution keep theirs, so the next prepareToPlay() stays cheap)
+    leftChannelFIFO.release();
+    rightChannelFIFO.release();
+    
+    // Whatever comes next starts from silence
+    resetProcessingState();
+    wasTransportPlaying = false;
+    wasBypassedByHost = false;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -104,12 +114,9 @@ bool _3BandEQAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts)
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any number of channels works: the IIR chains process them in SIMD groups,...
+    // ...and the linear phase convolution in pairs. We just need at least one of them.
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -128,33 +135,136 @@ void _3BandEQAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlo
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
     
-    // Set up Process Spec
-    juce::dsp::ProcessSpec processSpec;
-    processSpec.maximumBlockSize = samplesPerBlock;
-    processSpec.numChannels = 1;
-    processSpec.sampleRate = sampleRate;
-    
-    // Prepare both the left and right chains with our Process Spec
-    leftChain.prepare(processSpec);
-    rightChain.prepare(processSpec);
-
-    // Get the current parameter values and update all filters in the chain
-    updateFilters();
+    // Hosts call this a lot (e.g. for every track while a session loads), usually with the...
+    // ...same spec as last time. Then all the storage we have is still good, and only needs clearing.
+    PreparedSpec newSpec { sampleRate, samplesPerBlock, getTotalNumOutputChannels(), isUsingDoublePrecision() };
+    if (newSpec == preparedSpec)
+    {
+        resetProcessingState();
+    }
+    else
+    {
+        // Set up Process Spec
+        juce::dsp::ProcessSpec processSpec;
+        processSpec.maximumBlockSize = (juce::uint32)samplesPerBlock;
+        processSpec.numChannels = (juce::uint32)newSpec.numChannels;
+        processSpec.sampleRate = sampleRate;
+        
+        // Prepare the IIR chain for whichever precision the host is going to call us with.
+        // (Hosts have to set the precision before calling prepareToPlay(), so we only need one of them.)
+        if (newSpec.doublePrecision)
+        {
+            doubleIIRChain.prepare((size_t)newSpec.numChannels, samplesPerBlock);
+            convolutionBuffer.setSize(newSpec.numChannels, samplesPerBlock);
+        }
+        else
+        {
+            floatIIRChain.prepare((size_t)newSpec.numChannels, samplesPerBlock);
+        }
+        
+        // ...and the linear phase convolution, which processes every channel itself
+        linearPhaseConvolution.prepare(processSpec);
+        
+        // ...and the host bypass delay, long enough for the biggest linear phase kernel or 4x oversampling
+        maxBypassDelayInSamples = juce::jmax((1 << getLinearPhaseKernelOrder(2)) / 2,
+                                             (int)std::ceil(newSpec.doublePrecision ? doubleIIRChain.getLatencyInSamples(2)
+                                                                                    : floatIIRChain.getLatencyInSamples(2)));
+        if (newSpec.doublePrecision)
+        {
+            doubleBypassDelay.setMaximumDelayInSamples(maxBypassDelayInSamples);
+            doubleBypassDelay.prepare(processSpec);
+        }
+        else
+        {
+            floatBypassDelay.setMaximumDelayInSamples(maxBypassDelayInSamples);
+            floatBypassDelay.prepare(processSpec);
+        }
+        
+        preparedSpec = newSpec;
+    }
     
-    // prepare our left and right channel buffer FIFOs
+    // prepare our left and right channel buffer FIFOs.
+    // (They only allocate once an editor starts reading from them, and releaseResources() may...
+    // ...have freed them even if the spec hasn't changed.)
     leftChannelFIFO.prepare(samplesPerBlock);
     rightChannelFIFO.prepare(samplesPerBlock);
     
-    // TEST OSCILLATOR
-    osc.initialise([](float x) { return std::sin(x); });
-    processSpec.numChannels = getTotalNumOutputChannels();
-    osc.prepare(processSpec);
-    osc.setFrequency(1000);
+    // Everything starts from silence, so there's no tail to wait for
+    numSilentInputSamples = 0;
+    isSleeping = false;
+
+    // Get the current parameter values and update all filters in the chain.
+    // We're not on the audio thread yet, so we can design the filters right here.
+    // Nothing is playing yet, so there's nothing to glide from either.
+    updateFiltersImmediately(false);
+    
+    // Start the filter design thread, which handles parameter changes during playback
+    if (! filterDesignThread.isThreadRunning())
+        filterDesignThread.startThread();
 }
 
 void _3BandEQAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processSamples(buffer);
+}
+
+void _3BandEQAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processSamples(buffer);
+}
+
+void _3BandEQAudioProcessor::processBlockBypassed (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processBypassed(buffer);
+}
+
+void _3BandEQAudioProcessor::processBlockBypassed (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processBypassed(buffer);
+}
+
+template<typename SampleType>
+void _3BandEQAudioProcessor::processBypassed(juce::AudioBuffer<SampleType>& buffer)
+{
+    // (Not AudioProcessor::processBlockBypassed(), which passes the input straight through...
+    // ...and so only works for plugins without any latency)
+    auto& bypassDelay = getBypassDelay<SampleType>();
+    
+    // Coming into bypass: whatever was left in the delay from last time is long out of date
+    if (! wasBypassedByHost)
+        bypassDelay.reset();
+    wasBypassedByHost = true;
+    
+    for (auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
+        buffer.clear (i, 0, buffer.getNumSamples());
+    
+    // The host switched precision without preparing us again, so there's nothing to delay with
+    const auto isPrepared = preparedSpec.doublePrecision == std::is_same_v<SampleType, double>
+                         && buffer.getNumChannels() == preparedSpec.numChannels;
+    jassert(isPrepared);
+    
+    // (Our latency, which the host may not have caught up with yet, see reportLatency())
+    const auto latency = latencyInSamples.load();
+    if (latency == 0 || ! isPrepared)
+        return;
+    
+    bypassDelay.setDelay((SampleType)juce::jmin(latency, maxBypassDelayInSamples));
+    
+    juce::dsp::AudioBlock<SampleType> block(buffer);
+    juce::dsp::ProcessContextReplacing<SampleType> context(block);
+    bypassDelay.process(context);
+}
+
+template<typename SampleType>
+void _3BandEQAudioProcessor::processSamples(juce::AudioBuffer<SampleType>& buffer)
 {
     juce::ScopedNoDenormals noDenormals;
+    ProcessingStats::ScopedBlockTimer blockTimer(processingStats, buffer.getNumSamples(), getSampleRate(), ! isNonRealtime());
+    const juce::ScopedValueSetter<bool> realtimeBlock(isInsideRealtimeBlock, ! isNonRealtime());
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -167,29 +277,46 @@ void _3BandEQAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juc
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
     
-    // Get the current parameter values and update all filters in the chain
-    updateFilters();
+    resetOnTransportOrBypassChange();
+    
+    // Sleep mode: the input is silent and whatever was ringing in the filters has died away,...
+    // ...so there's nothing to filter or analyse. Keep up with parameter changes though.
+    if (shouldSleep(buffer, totalNumInputChannels))
+    {
+        updateFilters();
+        buffer.clear();
+        return;
+    }
     
     // create audio block with size of our buffer
-    juce::dsp::AudioBlock<float> block(buffer);
-   
-    // TEST OSCILLATOR
-//    buffer.clear();
-//    juce::dsp::ProcessContextReplacing<float> stereoContext(block);
-//    osc.process(stereoContext);
-    
-    // extract left and right channels separately from audio block
-    auto leftBlock = block.getSingleChannelBlock(0);
-    auto rightBlock = block.getSingleChannelBlock(1);
-    // create processing context for left and right channels
-    juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
-    juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
-    // tell the left and right mono processing chains to use these processing contexts
-    leftChain.process(leftContext);
-    rightChain.process(rightContext);
+    juce::dsp::AudioBlock<SampleType> block(buffer);
+    
+    // Either spread this block's parameter changes over fixed-size sub-blocks,...
+    // ...or update the filters once and run the whole block through them
+    if (! processInSubBlocks(block))
+    {
+        // Get the current parameter values and update all filters in the chain
+        updateFilters();
+        
+        if (isLinearPhaseActive)
+        {
+            // The kernel has the response of the whole chain baked into it
+            processLinearPhase(block);
+        }
+        else
+        {
+            auto& iirChain = getIIRChain<SampleType>();
+            // The host switched precision without preparing us again, so there's nothing to filter with
+            jassert(iirChain.isPrepared());
+            
+            // (If smoothing was switched off in the middle of a glide, finish it at the default rate)
+            auto controlInterval = getSmoothingControlInterval();
+            if (iirChain.isPrepared())
+                iirChain.process(block, appliedOversamplingOrder, controlInterval > 0 ? controlInterval : 32);
+        }
+    }
     // update left and right channel buffer FIFOs
-    leftChannelFIFO.update(buffer);
-    rightChannelFIFO.update(buffer);
+    updateAnalyzerFIFOs(buffer);
 }
 
 //==============================================================================
@@ -207,51 +334,326 @@ juce::AudioProcessorEditor* _3BandEQAudioProcessor::createEditor()
 //==============================================================================
 void _3BandEQAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // Use JUCE ValueTree type as an intermediary to save parameter state to memory
+    // Hosts snapshot every instance for undo and autosave, so this has to be quick and small:...
+    // ...a few hundred bytes, rather than the whole ValueTree with every property name spelled out
     
     // Create a memory output stream
     // 'true' here means "append to existing data"
     juce::MemoryOutputStream MOS(destData, true);
-    // Write our APVTS current state to the memory output stream
-    APVTS.state.writeToStream(MOS);
+    writeBinaryState(MOS);
 }
 
 void _3BandEQAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // Restore parameter state from memory, using JUCE ValueTree type as intermediary
+    // Every parameter changes at once, so the chain's settings only get rebuilt once, at the end.
+    // No need to update the filters here: updateFilters() notices the changed...
+    // ...parameters on the next block, and prepareToPlay() designs them if we aren't playing yet.
+    ChainSettingsSnapshot::ScopedBatch batch(chainSettingsSnapshot);
+    
+    // A binary state from a newer version is left alone, rather than read as something else
+    if (readBinaryState(data, sizeInBytes) != BinaryStateResult::notBinary)
+        return;
+    
+    // Otherwise it's from a version that saved the APVTS ValueTree
     
     // Grab the stored parameter values
     auto valueTree = juce::ValueTree::readFromData(data, sizeInBytes);
     // Make sure the values are valid
     if( valueTree.isValid() )
     {
-        // Feed the values to our APVTS
+        // Feed the values to our APVTS.
         APVTS.replaceState(valueTree);
-        // Update filter values to reflect the new state
-        updateFilters();
     }
 }
 
-// Helper function to return all parameter values from the APVTS as a ChainSettings struct
-ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& APVTS)
+// The key a parameter is saved under: 32 bit FNV-1a over the UTF-8 bytes of its ID.
+// Saved states depend on this never changing, so it's spelled out here rather than...
+// ...borrowed from somewhere (like String::hashCode()) that's free to change between versions.
+static juce::uint32 getStateParameterHash(const juce::String& paramID)
+{
+    juce::uint32 hash = 2166136261u;
+    
+    for (auto* c = paramID.toRawUTF8(); *c != 0; c++)
+    {
+        hash ^= (juce::uint8)*c;
+        hash *= 16777619u;
+    }
+    
+    return hash;
+}
+
+void _3BandEQAudioProcessor::writeBinaryState(juce::OutputStream& stream) const
+{
+    const auto& parameters = getParameters();
+    
+    stream.writeInt((int)binaryStateMagic);
+    stream.writeInt((int)binaryStateVersion);
+    stream.writeInt(parameters.size());
+    
+    for (auto* parameter : parameters)
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter);
+        jassert(ranged != nullptr);
+        
+        // In its own units, so a state still means the same thing if a parameter's range changes
+        stream.writeInt((int)getStateParameterHash(ranged->paramID));
+        stream.writeFloat(ranged->convertFrom0to1(ranged->getValue()));
+    }
+}
+
+_3BandEQAudioProcessor::BinaryStateResult _3BandEQAudioProcessor::readBinaryState(const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream stream(data, (size_t)juce::jmax(0, sizeInBytes), false);
+    
+    if (sizeInBytes < 4 || (juce::uint32)stream.readInt() != binaryStateMagic)
+        return BinaryStateResult::notBinary;
+    
+    // From here on it's definitely one of ours, even if it's one we can't read
+    if (sizeInBytes < 12)
+        return BinaryStateResult::unsupported;
+    
+    // From a newer version than this one, which might mean something else entirely
+    if ((juce::uint32)stream.readInt() > binaryStateVersion)
+        return BinaryStateResult::unsupported;
+    
+    const auto numValues = stream.readInt();
+    if (numValues < 0 || stream.getNumBytesRemaining() < (juce::int64)numValues * 8)
+        return BinaryStateResult::unsupported;
+    
+    // (There are only a few dozen of these, so looking them up one by one below is fine)
+    std::vector<std::pair<int, float>> values((size_t)numValues);
+    for (auto& value : values)
+    {
+        value.first = stream.readInt();
+        value.second = stream.readFloat();
+    }
+    
+    // Parameters this state doesn't know about go back to their defaults, so a recall always...
+    // ...ends up in the same place whatever the instance was doing before
+    for (auto* parameter : getParameters())
+    {
+        auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter);
+        if (ranged == nullptr)
+            continue;
+        
+        const auto hash = (int)getStateParameterHash(ranged->paramID);
+        auto found = std::find_if(values.begin(), values.end(), [hash](const auto& value) { return value.first == hash; });
+        
+        auto newValue = found != values.end() ? ranged->convertTo0to1(found->second) : ranged->getDefaultValue();
+        if (newValue != ranged->getValue())
+            ranged->setValueNotifyingHost(newValue);
+    }
+    
+    return BinaryStateResult::loaded;
+}
+
+ChainParameters::ChainParameters(juce::AudioProcessorValueTreeState& APVTS) :
+lowCutFreq      (APVTS.getRawParameterValue("LowCut_Freq")),
+lowCutSlope     (APVTS.getRawParameterValue("LowCut_Slope")),
+lowCutBypass    (APVTS.getRawParameterValue("LowCut_Bypass")),
+highCutFreq     (APVTS.getRawParameterValue("HighCut_Freq")),
+highCutSlope    (APVTS.getRawParameterValue("HighCut_Slope")),
+highCutBypass   (APVTS.getRawParameterValue("HighCut_Bypass")),
+phaseMode           (APVTS.getRawParameterValue("Phase_Mode")),
+linearPhaseQuality  (APVTS.getRawParameterValue("Linear_Phase_Quality"))
+{
+    for (int band = 0; band < maxNumBands; band++)
+    {
+        auto& parameters = bands[(size_t)band];
+        parameters.type   = APVTS.getRawParameterValue(getBandParameterID(band, "Type"));
+        parameters.freq   = APVTS.getRawParameterValue(getBandParameterID(band, "Freq"));
+        parameters.gain   = APVTS.getRawParameterValue(getBandParameterID(band, "Gain"));
+        parameters.Q      = APVTS.getRawParameterValue(getBandParameterID(band, "Q"));
+        parameters.bypass = APVTS.getRawParameterValue(getBandParameterID(band, "Bypass"));
+        
+        jassert(parameters.type != nullptr && parameters.freq != nullptr && parameters.gain != nullptr
+                && parameters.Q != nullptr && parameters.bypass != nullptr);
+    }
+    
+    // If any of these fail, a parameter ID in createParameterLayout() has changed
+    jassert(lowCutFreq != nullptr && lowCutSlope != nullptr && lowCutBypass != nullptr);
+    jassert(highCutFreq != nullptr && highCutSlope != nullptr && highCutBypass != nullptr);
+    jassert(phaseMode != nullptr && linearPhaseQuality != nullptr);
+}
+
+juce::String getBandParameterID(int band, const juce::String& name)
+{
+    return (band == 0 ? juce::String("Peak") : "Peak" + juce::String(band + 1)) + "_" + name;
+}
+
+// Helper function to return all parameter values from the cached pointers as a ChainSettings struct
+ChainSettings getChainSettings(const ChainParameters& chainParameters)
 {
     ChainSettings settings;
     
-    // Get all current parameter values from APVTS
-    settings.lowCutFreq     = APVTS.getRawParameterValue("LowCut_Freq")->load();
-    settings.lowCutSlope    = static_cast<Slope>( APVTS.getRawParameterValue("LowCut_Slope")->load() );
+    settings.lowCutFreq     = chainParameters.lowCutFreq->load();
+    settings.lowCutSlope    = static_cast<Slope>( chainParameters.lowCutSlope->load() );
+    
+    settings.highCutFreq    = chainParameters.highCutFreq->load();
+    settings.highCutSlope   = static_cast<Slope>( chainParameters.highCutSlope->load() );
+    
+    for (size_t band = 0; band < (size_t)maxNumBands; band++)
+    {
+        const auto& parameters = chainParameters.bands[band];
+        auto& bandSettings = settings.bands[band];
+        
+        bandSettings.type    = static_cast<BandType>( juce::roundToInt(parameters.type->load()) );
+        bandSettings.freq    = parameters.freq->load();
+        bandSettings.gain_dB = parameters.gain->load();
+        bandSettings.Q       = parameters.Q->load();
+        bandSettings.bypass  = parameters.bypass->load() > 0.5f;
+    }
+    
+    settings.lowCutBypass   = chainParameters.lowCutBypass->load() > 0.5f;
+    settings.highCutBypass  = chainParameters.highCutBypass->load() > 0.5f;
+    
+    settings.linearPhase        = chainParameters.phaseMode->load() > 0.5f;
+    settings.linearPhaseQuality = juce::roundToInt( chainParameters.linearPhaseQuality->load() );
+    
+    return settings;
+}
+
+bool canInterpolateChainSettings(const ChainSettings& from, const ChainSettings& to)
+{
+    // Take the continuous settings out of the comparison, and see if anything else is left
+    auto withContinuousSettings = interpolateChainSettings(from, to, 1.f);
+    return withContinuousSettings == to;
+}
+
+ChainSettings interpolateChainSettings(const ChainSettings& from, const ChainSettings& to, float proportion)
+{
+    auto geometric = [proportion](float a, float b) { return a * std::pow(b / a, proportion); };
+    
+    auto settings = from;
+    
+    // Land exactly on the target at the end, so the next comparison with it sees no change
+    if (proportion >= 1.f)
+    {
+        settings.lowCutFreq  = to.lowCutFreq;
+        settings.highCutFreq = to.highCutFreq;
+        
+        for (size_t band = 0; band < (size_t)maxNumBands; band++)
+        {
+            settings.bands[band].freq    = to.bands[band].freq;
+            settings.bands[band].Q       = to.bands[band].Q;
+            settings.bands[band].gain_dB = to.bands[band].gain_dB;
+        }
+        
+        return settings;
+    }
+    
+    settings.lowCutFreq  = geometric(from.lowCutFreq, to.lowCutFreq);
+    settings.highCutFreq = geometric(from.highCutFreq, to.highCutFreq);
+    
+    for (size_t band = 0; band < (size_t)maxNumBands; band++)
+    {
+        const auto& a = from.bands[band];
+        const auto& b = to.bands[band];
+        
+        settings.bands[band].freq    = geometric(a.freq, b.freq);
+        settings.bands[band].Q       = geometric(a.Q, b.Q);
+        settings.bands[band].gain_dB = a.gain_dB + proportion * (b.gain_dB - a.gain_dB);
+    }
+    
+    return settings;
+}
+
+// The parameters that make up ChainSettings
+static juce::StringArray getChainParameterIDs()
+{
+    juce::StringArray parameterIDs { "LowCut_Freq", "LowCut_Slope", "LowCut_Bypass",
+                                     "HighCut_Freq", "HighCut_Slope", "HighCut_Bypass",
+                                     "Phase_Mode", "Linear_Phase_Quality" };
+    
+    for (int band = 0; band < maxNumBands; band++)
+    {
+        for (auto* name : { "Type", "Freq", "Gain", "Q", "Bypass" })
+            parameterIDs.add(getBandParameterID(band, name));
+    }
+    
+    return parameterIDs;
+}
+
+ChainSettingsSnapshot::ChainSettingsSnapshot(juce::AudioProcessorValueTreeState& apvts) :
+APVTS(apvts),
+parameters(apvts)
+{
+    for (const auto& parameterID : getChainParameterIDs())
+        APVTS.addParameterListener(parameterID, this);
+    
+    write(getChainSettings(parameters));
+}
+
+ChainSettingsSnapshot::~ChainSettingsSnapshot()
+{
+    for (const auto& parameterID : getChainParameterIDs())
+        APVTS.removeParameterListener(parameterID, this);
+}
+
+void ChainSettingsSnapshot::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(parameterID, newValue);
+    
+    // A batch is in progress, which writes everything once it's done
+    if (batchDepth.load() > 0)
+        return;
+    
+    // The raw parameter values are already up to date, so just take a fresh copy of all of them.
+    // (Under the lock, so two threads changing parameters at once can't write an older copy last.)
+    const juce::SpinLock::ScopedLockType sl(writeLock);
+    write(getChainSettings(parameters));
+}
+
+void ChainSettingsSnapshot::endBatch()
+{
+    // The last batch to finish picks up everything that changed while any of them were running
+    if (--batchDepth == 0)
+    {
+        const juce::SpinLock::ScopedLockType sl(writeLock);
+        write(getChainSettings(parameters));
+    }
+}
+
+void ChainSettingsSnapshot::write(const ChainSettings& settings) noexcept
+{
+    std::array<juce::uint32, numWords> packed {};
+    std::memcpy(packed.data(), &settings, sizeof(ChainSettings));
     
-    settings.highCutFreq    = APVTS.getRawParameterValue("HighCut_Freq")->load();
-    settings.highCutSlope   = static_cast<Slope>( APVTS.getRawParameterValue("HighCut_Slope")->load() );
+    // Odd sequence numbers tell readers that a write is in progress
+    auto start = sequence.load(std::memory_order_relaxed);
+    sequence.store(start + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
     
-    settings.peakFreq       = APVTS.getRawParameterValue("Peak_Freq")->load();
-    settings.peakGain_dB    = APVTS.getRawParameterValue("Peak_Gain")->load();
-    settings.peakQ          = APVTS.getRawParameterValue("Peak_Q")->load();
+    for (size_t i = 0; i < numWords; i++)
+        words[i].store(packed[i], std::memory_order_relaxed);
     
-    settings.lowCutBypass   = APVTS.getRawParameterValue("LowCut_Bypass")->load() > 0.5f;
-    settings.highCutBypass  = APVTS.getRawParameterValue("HighCut_Bypass")->load() > 0.5f;
-    settings.peakBypass     = APVTS.getRawParameterValue("Peak_Bypass")->load() > 0.5f;
+    sequence.store(start + 2, std::memory_order_release);
+}
+
+ChainSettings ChainSettingsSnapshot::read() const noexcept
+{
+    std::array<juce::uint32, numWords> packed;
     
+    for (;;)
+    {
+        auto before = sequence.load(std::memory_order_acquire);
+        
+        // A write is in progress, and will be done in a moment
+        if ((before & 1) != 0)
+            continue;
+        
+        for (size_t i = 0; i < numWords; i++)
+            packed[i] = words[i].load(std::memory_order_relaxed);
+        
+        std::atomic_thread_fence(std::memory_order_acquire);
+        
+        // Nothing was written while we were reading, so this is one consistent set of values
+        if (sequence.load(std::memory_order_relaxed) == before)
+            break;
+    }
+    
+    ChainSettings settings;
+    std::memcpy(&settings, packed.data(), sizeof(ChainSettings));
     return settings;
 }
 
@@ -264,75 +666,817 @@ Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRat
     // Calculate Peak filter coefficients based on current chain settings.
     // This is a reference-counted wrapper around an array of float values,
     //    allocated on the heap (which is "bad"? Look into this. Why is heap bad for real-time audio?)
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate,
-                                                               chainSettings.peakFreq,
-                                                               chainSettings.peakQ,
-                                                               juce::Decibels::decibelsToGain(chainSettings.peakGain_dB));
+    const auto& band = chainSettings.bands[0];
+    return juce::dsp::IIR::Coefficients<double>::makePeakFilter(sampleRate,
+                                                                band.freq,
+                                                                band.Q,
+                                                                juce::Decibels::decibelsToGain((double)band.gain_dB));
 }
 
-// Helper function to update filter coefficients
-// (Free function)
-void updateCoefficients(Coefficients &old, const Coefficients &replacement)
+// Helper function to normalise a biquad so that a0 == 1, like JUCE's Coefficients constructor does
+static DesignedCoefficients normalisedBiquad(double b0, double b1, double b2, double a0, double a1, double a2)
 {
-    // Because JUCE DSP's IIR Coefficients are reference-counted on the heap, we need to dereference here
-    *old = *replacement;
+    return { b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0 };
 }
 
-// Helper function to update the low cut filter
-void _3BandEQAudioProcessor::updateLowCutFilter(const ChainSettings &chainSettings)
+DesignedCoefficients designPeakFilter(double sampleRate, double frequency, double Q, double gainFactor)
 {
-    // Calculate low cut filter coefficients
-    auto lowCutFilterCoefficients = makeLowCutFilter(chainSettings, getSampleRate());
-    // Get the low cut filter (left and right chains)
-    auto& leftLowCutFilter = leftChain.get<ChainPositions::LowCut>();
-    auto& rightLowCutFilter = rightChain.get<ChainPositions::LowCut>();
-    // Update low cut filter bypass setting
-    leftChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypass);
-    rightChain.setBypassed<ChainPositions::LowCut>(chainSettings.lowCutBypass);
-    // Use chain settings to calculate new filter coefficients and apply them to the filter (L and R chains)
-    updateCutFilter(leftLowCutFilter, lowCutFilterCoefficients, chainSettings.lowCutSlope);
-    updateCutFilter(rightLowCutFilter, lowCutFilterCoefficients, chainSettings.lowCutSlope);
+    const auto A = juce::jmax(0.0, std::sqrt(gainFactor));
+    const auto omega = (juce::MathConstants<double>::twoPi * juce::jmax(frequency, 2.0)) / sampleRate;
+    const auto alpha = std::sin(omega) / (Q * 2.0);
+    const auto c2 = -2.0 * std::cos(omega);
+    const auto alphaTimesA = alpha * A;
+    const auto alphaOverA = alpha / A;
+    
+    return normalisedBiquad(1.0 + alphaTimesA, c2, 1.0 - alphaTimesA, 1.0 + alphaOverA, c2, 1.0 - alphaOverA);
 }
 
-// Helper function to update the high cut filter
-void _3BandEQAudioProcessor::updateHighCutFilter(const ChainSettings &chainSettings)
+DesignedCoefficients designLowShelf(double sampleRate, double frequency, double Q, double gainFactor)
 {
-    // Calculate high cut filter coefficients
-    auto highCutFilterCoefficients = makeHighCutFilter(chainSettings, getSampleRate()); 
-    // Get the high cut filter (left and right chains)
-    auto& leftHighCutFilter = leftChain.get<ChainPositions::HighCut>();
-    auto& rightHighCutFilter = rightChain.get<ChainPositions::HighCut>();
-    // Update high cut filter bypass setting
-    leftChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypass);
-    rightChain.setBypassed<ChainPositions::HighCut>(chainSettings.highCutBypass);
-    // Use chain settings to calculate new filter coefficients and apply them to the filter (L and R chains)
-    updateCutFilter(leftHighCutFilter, highCutFilterCoefficients, chainSettings.highCutSlope);
-    updateCutFilter(rightHighCutFilter, highCutFilterCoefficients, chainSettings.highCutSlope);
+    const auto A = juce::jmax(0.0, std::sqrt(gainFactor));
+    const auto aMinus1 = A - 1.0;
+    const auto aPlus1 = A + 1.0;
+    const auto omega = (juce::MathConstants<double>::twoPi * juce::jmax(frequency, 2.0)) / sampleRate;
+    const auto cosOmega = std::cos(omega);
+    const auto beta = std::sin(omega) * std::sqrt(A) / Q;
+    const auto aMinus1TimesCos = aMinus1 * cosOmega;
+    
+    return normalisedBiquad(A * (aPlus1 - aMinus1TimesCos + beta),
+                            A * 2.0 * (aMinus1 - aPlus1 * cosOmega),
+                            A * (aPlus1 - aMinus1TimesCos - beta),
+                            aPlus1 + aMinus1TimesCos + beta,
+                            -2.0 * (aMinus1 + aPlus1 * cosOmega),
+                            aPlus1 + aMinus1TimesCos - beta);
 }
 
-// Helper function to update the peak filter
-void _3BandEQAudioProcessor::updatePeakFilter(const ChainSettings &chainSettings)
+DesignedCoefficients designHighShelf(double sampleRate, double frequency, double Q, double gainFactor)
 {
-    // Calculate Peak filter coefficients based on current chain settings.
-    auto updatedPeakCoefficients = makePeakFilter(chainSettings, getSampleRate());
-    // Update peak filter bypass setting
-    leftChain.setBypassed<ChainPositions::Peak>(chainSettings.peakBypass);
-    rightChain.setBypassed<ChainPositions::Peak>(chainSettings.peakBypass);
-    // Apply those coefficients to the peak filter (left chain and right chain)
-    updateCoefficients(leftChain.get<ChainPositions::Peak>().coefficients, updatedPeakCoefficients);
-    updateCoefficients(rightChain.get<ChainPositions::Peak>().coefficients, updatedPeakCoefficients);
+    const auto A = juce::jmax(0.0, std::sqrt(gainFactor));
+    const auto aMinus1 = A - 1.0;
+    const auto aPlus1 = A + 1.0;
+    const auto omega = (juce::MathConstants<double>::twoPi * juce::jmax(frequency, 2.0)) / sampleRate;
+    const auto cosOmega = std::cos(omega);
+    const auto beta = std::sin(omega) * std::sqrt(A) / Q;
+    const auto aMinus1TimesCos = aMinus1 * cosOmega;
+    
+    return normalisedBiquad(A * (aPlus1 + aMinus1TimesCos + beta),
+                            A * -2.0 * (aMinus1 + aPlus1 * cosOmega),
+                            A * (aPlus1 + aMinus1TimesCos - beta),
+                            aPlus1 - aMinus1TimesCos + beta,
+                            2.0 * (aMinus1 - aPlus1 * cosOmega),
+                            aPlus1 - aMinus1TimesCos - beta);
+}
+
+DesignedCoefficients designNotch(double sampleRate, double frequency, double Q)
+{
+    const auto n = 1.0 / std::tan(juce::MathConstants<double>::pi * frequency / sampleRate);
+    const auto nSquared = n * n;
+    const auto invQ = 1.0 / Q;
+    const auto c1 = 1.0 / (1.0 + n * invQ + nSquared);
+    const auto b0 = c1 * (1.0 + nSquared);
+    const auto b1 = 2.0 * c1 * (1.0 - nSquared);
+    
+    return { b0, b1, b0, b1, c1 * (1.0 - n * invQ + nSquared) };
+}
+
+DesignedCoefficients designHighPass(double sampleRate, double frequency, double Q)
+{
+    const auto n = std::tan(juce::MathConstants<double>::pi * frequency / sampleRate);
+    const auto nSquared = n * n;
+    const auto invQ = 1.0 / Q;
+    const auto c1 = 1.0 / (1.0 + n * invQ + nSquared);
+    
+    return { c1, c1 * -2.0, c1, c1 * 2.0 * (nSquared - 1.0), c1 * (1.0 - n * invQ + nSquared) };
+}
+
+DesignedCoefficients designLowPass(double sampleRate, double frequency, double Q)
+{
+    const auto n = 1.0 / std::tan(juce::MathConstants<double>::pi * frequency / sampleRate);
+    const auto nSquared = n * n;
+    const auto invQ = 1.0 / Q;
+    const auto c1 = 1.0 / (1.0 + invQ * n + nSquared);
+    
+    return { c1, c1 * 2.0, c1, c1 * 2.0 * (1.0 - nSquared), c1 * (1.0 - invQ * n + nSquared) };
+}
+
+// Q of each section in a Butterworth cascade of numSections biquads,...
+// ...the same as FilterDesign's HighOrderButterworthMethod functions use
+static double getButterworthSectionQ(int section, int numSections)
+{
+    const auto order = 2 * numSections;
+    return 1.0 / (2.0 * std::cos((2.0 * section + 1.0) * juce::MathConstants<double>::pi / (order * 2.0)));
+}
+
+DesignedCoefficients designBand(const BandSettings& band, double sampleRate)
+{
+    const auto gainFactor = juce::Decibels::decibelsToGain((double)band.gain_dB);
+    
+    switch (band.type)
+    {
+        case BAND_LOW_SHELF:    return designLowShelf(sampleRate, band.freq, band.Q, gainFactor);
+        case BAND_HIGH_SHELF:   return designHighShelf(sampleRate, band.freq, band.Q, gainFactor);
+        case BAND_NOTCH:        return designNotch(sampleRate, band.freq, band.Q);
+        case BAND_BELL:
+        default:                return designPeakFilter(sampleRate, band.freq, band.Q, gainFactor);
+    }
+}
+
+// Helper function to design every filter in the chain
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate)
+{
+    ChainCoefficients chainCoefficients;
+    chainCoefficients.settings = chainSettings;
+    chainCoefficients.sampleRate = sampleRate;
+    
+    for (size_t band = 0; band < (size_t)maxNumBands; band++)
+    {
+        if (! chainSettings.bands[band].bypass)
+            chainCoefficients.bands[band] = designBand(chainSettings.bands[band], sampleRate);
+    }
+    
+    // The cut filters use one biquad per 12 dB/oct of slope
+    const auto numLowCutSections = (int)chainSettings.lowCutSlope + 1;
+    for (int i = 0; i < numLowCutSections; i++)
+        chainCoefficients.lowCut[(size_t)i] = designHighPass(sampleRate,
+                                                             chainSettings.lowCutFreq,
+                                                             getButterworthSectionQ(i, numLowCutSections));
+    
+    const auto numHighCutSections = (int)chainSettings.highCutSlope + 1;
+    for (int i = 0; i < numHighCutSections; i++)
+        chainCoefficients.highCut[(size_t)i] = designLowPass(sampleRate,
+                                                             chainSettings.highCutFreq,
+                                                             getButterworthSectionQ(i, numHighCutSections));
+    
+    return chainCoefficients;
+}
+
+void multiplyChainSquaredMagnitudes(const ChainCoefficients& chainCoefficients,
+                                    const FrequencyResponseTable& responseTable,
+                                    double* magnitudesSquared)
+{
+    const auto& chainSettings = chainCoefficients.settings;
+    // Parametric Bands
+    for (size_t band = 0; band < (size_t)maxNumBands; band++)
+    {
+        if (! chainSettings.bands[band].bypass)
+            responseTable.multiplySquaredMagnitudes(chainCoefficients.bands[band], magnitudesSquared);
+    }
+    // Low Cut Filter (one 12dB/oct section per step of slope)
+    if (! chainSettings.lowCutBypass)
+    {
+        for (int i = 0; i <= chainSettings.lowCutSlope; i++)
+            responseTable.multiplySquaredMagnitudes(chainCoefficients.lowCut[(size_t)i], magnitudesSquared);
+    }
+    // High Cut Filter
+    if (! chainSettings.highCutBypass)
+    {
+        for (int i = 0; i <= chainSettings.highCutSlope; i++)
+            responseTable.multiplySquaredMagnitudes(chainCoefficients.highCut[(size_t)i], magnitudesSquared);
+    }
+}
+
+double getChainTailLengthInSamples(const ChainCoefficients& chainCoefficients, double decayFactor)
+{
+    const auto& chainSettings = chainCoefficients.settings;
+    // (Anything that rings for longer than 10 s is broken anyway)
+    const auto maxSamples = 10.0 * chainCoefficients.sampleRate;
+    
+    // The sections run in series, so their tails add up (which overestimates it a little)
+    auto tailLength = 0.0;
+    for (size_t band = 0; band < (size_t)maxNumBands; band++)
+    {
+        if (! chainSettings.bands[band].bypass)
+            tailLength += getBiquadDecayTimeInSamples(chainCoefficients.bands[band], decayFactor, maxSamples);
+    }
+    if (! chainSettings.lowCutBypass)
+    {
+        for (int i = 0; i <= chainSettings.lowCutSlope; i++)
+            tailLength += getBiquadDecayTimeInSamples(chainCoefficients.lowCut[(size_t)i], decayFactor, maxSamples);
+    }
+    if (! chainSettings.highCutBypass)
+    {
+        for (int i = 0; i <= chainSettings.highCutSlope; i++)
+            tailLength += getBiquadDecayTimeInSamples(chainCoefficients.highCut[(size_t)i], decayFactor, maxSamples);
+    }
+    
+    return juce::jmin(tailLength, maxSamples);
+}
+
+// Helper function to design the linear phase FIR version of the chain (frequency sampling method)
+juce::AudioBuffer<float> makeLinearPhaseKernel(const ChainCoefficients& chainCoefficients)
+{
+    const auto kernelOrder = getLinearPhaseKernelOrder(chainCoefficients.settings.linearPhaseQuality);
+    const auto kernelSize = 1 << kernelOrder;
+    const auto numBins = kernelSize / 2 + 1;
+    
+    // Sample the chain's magnitude response at every FFT bin, from DC up to Nyquist
+    FrequencyResponseTable responseTable;
+    responseTable.prepareLinear(numBins, chainCoefficients.sampleRate);
+    std::vector<double> magnitudes((size_t)numBins, 1.0);
+    multiplyChainSquaredMagnitudes(chainCoefficients, responseTable, magnitudes.data());
+    
+    // Zero phase spectrum: real magnitudes only, as interleaved complex bins for JUCE's real-only FFT
+    std::vector<float> spectrum((size_t)kernelSize * 2, 0.f);
+    for (int bin = 0; bin < numBins; bin++)
+        spectrum[(size_t)bin * 2] = (float)std::sqrt(magnitudes[(size_t)bin]);
+    
+    juce::dsp::FFT fft(kernelOrder);
+    fft.performRealOnlyInverseTransform(spectrum.data());
+    
+    // The zero phase impulse response is centred on sample 0 (and wraps around), so rotate it...
+    // ...into the middle of the kernel. Then window it to smooth out the truncation.
+    // (A periodic Blackman window, so it's symmetric around the centre sample as well.)
+    juce::AudioBuffer<float> kernel(1, kernelSize);
+    auto* kernelData = kernel.getWritePointer(0);
+    
+    for (int n = 0; n < kernelSize; n++)
+    {
+        auto phase = juce::MathConstants<double>::twoPi * n / kernelSize;
+        auto window = 0.42 - 0.5 * std::cos(phase) + 0.08 * std::cos(2.0 * phase);
+        kernelData[n] = (float)(window * spectrum[(size_t)((n + kernelSize / 2) % kernelSize)]);
+    }
+    
+    return kernel;
+}
+
+void loadLinearPhaseKernel(MultichannelConvolution& convolution, const ChainCoefficients& chainCoefficients, bool shouldLoadNow)
+{
+    if (shouldLoadNow)
+        convolution.loadImpulseResponseNow(makeLinearPhaseKernel(chainCoefficients), chainCoefficients.sampleRate);
+    else
+        convolution.loadImpulseResponse(makeLinearPhaseKernel(chainCoefficients), chainCoefficients.sampleRate);
+}
+
+void MultichannelConvolution::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    const juce::ScopedLock sl(lock);
+    
+    preparedSpec = spec;
+    isPrepared = true;
+    
+    // Nothing to do until linear phase is first asked for...
+    // ...but once the convolutions exist they have to keep up with the spec
+    if (! convolutions.empty() || currentKernel.getNumSamples() > 0)
+        prepareConvolutions();
+}
+
+void MultichannelConvolution::prepareConvolutions()
+{
+    if (messageQueue == nullptr)
+        messageQueue = std::make_unique<juce::SharedResourcePointer<SharedMessageQueue>>();
+    
+    const auto numPairs = juce::jmax((size_t)1, ((size_t)preparedSpec.numChannels + 1) / 2);
+    while (convolutions.size() < numPairs)
+    {
+        convolutions.push_back(std::make_unique<juce::dsp::Convolution>(juce::dsp::Convolution::NonUniform {256},
+                                                                        messageQueue->getObject().queue));
+        
+        if (currentKernel.getNumSamples() > 0)
+            convolutions.back()->loadImpulseResponse(juce::AudioBuffer<float>(currentKernel),
+                                                     currentKernelSampleRate,
+                                                     juce::dsp::Convolution::Stereo::no,
+                                                     juce::dsp::Convolution::Trim::no,
+                                                     juce::dsp::Convolution::Normalise::no);
+    }
+    convolutions.resize(numPairs);
+    
+    auto pairSpec = preparedSpec;
+    pairSpec.numChannels = 2;
+    for (auto& convolution : convolutions)
+        convolution->prepare(pairSpec);
+    
+    hasConvolutions.store(true, std::memory_order_release);
+}
+
+void MultichannelConvolution::loadImpulseResponse(const juce::AudioBuffer<float>& kernel, double kernelSampleRate)
+{
+    const juce::ScopedLock sl(lock);
+    
+    currentKernel.makeCopyOf(kernel);
+    currentKernelSampleRate = kernelSampleRate;
+    
+    // The first kernel: the convolutions get made now, and start out with it
+    if (convolutions.empty())
+    {
+        if (isPrepared)
+            prepareConvolutions();
+        return;
+    }
+    
+    // The same (mono) kernel is used for every channel. It already has the right gain, so no normalising.
+    for (auto& convolution : convolutions)
+        convolution->loadImpulseResponse(juce::AudioBuffer<float>(kernel),
+                                         kernelSampleRate,
+                                         juce::dsp::Convolution::Stereo::no,
+                                         juce::dsp::Convolution::Trim::no,
+                                         juce::dsp::Convolution::Normalise::no);
+}
+
+void MultichannelConvolution::loadImpulseResponseNow(const juce::AudioBuffer<float>& kernel, double kernelSampleRate)
+{
+    const juce::ScopedLock sl(lock);
+    
+    loadImpulseResponse(kernel, kernelSampleRate);
+    
+    // Convolution::prepare() handles whatever's waiting in the message queue on this thread,...
+    // ...and builds its engine from the newest kernel right there, instead of in the background
+    if (! convolutions.empty())
+        prepareConvolutions();
+}
+
+void MultichannelConvolution::reset() noexcept
+{
+    if (! hasConvolutions.load(std::memory_order_acquire))
+        return;
+    
+    for (auto& convolution : convolutions)
+        convolution->reset();
+}
+
+void MultichannelConvolution::process(juce::dsp::AudioBlock<float>& block) noexcept
+{
+    // (Linear phase can't be active before its first kernel has been loaded)
+    if (! hasConvolutions.load(std::memory_order_acquire))
+    {
+        jassertfalse;
+        return;
+    }
+    
+    const auto numChannels = block.getNumChannels();
+    jassert(numChannels <= convolutions.size() * 2);
+    
+    for (size_t pair = 0; pair < convolutions.size() && pair * 2 < numChannels; pair++)
+    {
+        auto pairBlock = block.getSubsetChannelBlock(pair * 2, juce::jmin((size_t)2, numChannels - pair * 2));
+        juce::dsp::ProcessContextReplacing<float> context(pairBlock);
+        convolutions[pair]->process(context);
+    }
+}
+
+// Helper function to apply a full set of designed coefficients to the chain
+void _3BandEQAudioProcessor::applyChainCoefficients(const ChainCoefficients &chainCoefficients, bool shouldSmooth)
+{
+    const auto& chainSettings = chainCoefficients.settings;
+    
+    // How many control steps the coefficients take to reach the new design (0 means jump straight there)
+    auto controlInterval = getSmoothingControlInterval();
+    auto numSteps = 0;
+    if (shouldSmooth && controlInterval > 0)
+        numSteps = juce::jmax(1, juce::roundToInt(smoothingTimeSeconds * chainCoefficients.sampleRate / (double)controlInterval));
+    
+    // Bypass and slope changes crossfade instead, whenever we'd glide (even with smoothing off)
+    auto crossfadeSamples = shouldSmooth ? juce::roundToInt(transitionTimeSeconds * chainCoefficients.sampleRate) : 0;
+    
+    setChainCoefficients(chainCoefficients, numSteps, crossfadeSamples);
+    
+    // Coefficients designed for one rate are meaningless at another, so the oversampling factor...
+    // ...only ever changes together with the design made for it
+    if (chainSettings.oversamplingOrder != appliedOversamplingOrder)
+    {
+        appliedOversamplingOrder = chainSettings.oversamplingOrder;
+        floatIIRChain.reset(appliedOversamplingOrder);
+        doubleIIRChain.reset(appliedOversamplingOrder);
+    }
+    
+    // Switch between the IIR chain and the convolution. By now the kernel for this design has...
+    // ...already been handed to the convolution, which crossfades over to it by itself.
+    if (chainSettings.linearPhase != isLinearPhaseActive)
+    {
+        isLinearPhaseActive = chainSettings.linearPhase;
+        
+        // Start whichever one we switched to from silence, rather than from whatever it had left over
+        if (isLinearPhaseActive)
+        {
+            linearPhaseConvolution.reset();
+        }
+        else
+        {
+            floatIIRChain.reset(appliedOversamplingOrder);
+            doubleIIRChain.reset(appliedOversamplingOrder);
+        }
+    }
+    
+    finishApplyingDesign(chainCoefficients);
+}
+
+void _3BandEQAudioProcessor::setChainCoefficients(const ChainCoefficients& chainCoefficients, int numSteps, int crossfadeSamples)
+{
+    // Both precisions get the design, so whichever one the host picks is always up to date
+    floatIIRChain.setTargetCoefficients(chainCoefficients, numSteps, crossfadeSamples);
+    doubleIIRChain.setTargetCoefficients(chainCoefficients, numSteps, crossfadeSamples);
+}
+
+void _3BandEQAudioProcessor::finishApplyingDesign(const ChainCoefficients& chainCoefficients)
+{
+    const auto& chainSettings = chainCoefficients.settings;
+    
+    // Linear phase delays everything by half the kernel length, and oversampling by however long...
+    // ...its halfband filters take.
+    auto latency = 0;
+    if (isLinearPhaseActive)
+        latency = (1 << getLinearPhaseKernelOrder(chainSettings.linearPhaseQuality)) / 2;
+    else if (isUsingDoublePrecision())
+        latency = juce::roundToInt(doubleIIRChain.getLatencyInSamples(appliedOversamplingOrder));
+    else
+        latency = juce::roundToInt(floatIIRChain.getLatencyInSamples(appliedOversamplingOrder));
+    
+    reportLatency(latency);
+    
+    // The output keeps going for as long as the chain rings, plus however late it comes out.
+    // A linear phase kernel is finite: it's over one kernel length after the input stops.
+    auto tailLength = (double)latency * 2.0;
+    if (! isLinearPhaseActive)
+        tailLength = getChainTailLengthInSamples(chainCoefficients, silenceThreshold) / (1 << appliedOversamplingOrder) + latency;
+    
+    tailLengthInSamples = (juce::int64)std::ceil(tailLength);
+    tailLengthSeconds = getSampleRate() > 0 ? tailLength / getSampleRate() : 0.0;
+    
+    appliedSettings = chainSettings;
+    appliedDesignId = chainCoefficients.designId;
+    processingStats.countDesignApplied();
 }
 
 // Helper function to update all the filters
 void _3BandEQAudioProcessor::updateFilters()
 {
     // Get the current chain settings (parameter values)
-    auto settings = getChainSettings(APVTS);
+    auto settings = chainSettingsSnapshot.read();
+    settings.oversamplingOrder = getOversamplingOrder(settings.linearPhase);
+    
+    // Only redesign the filters when something has actually changed
+    if (settings != lastRequestedSettings)
+    {
+        if (isNonRealtime())
+        {
+            // When rendering offline there's no deadline to miss, and we want every block to use...
+            // ...exactly the current settings, so design the filters right here
+            updateFiltersImmediately(true);
+            return;
+        }
+        
+        // Otherwise hand the work over to the design thread.
+        // If its queue is full, we'll simply try again next block.
+        if (filterDesignThread.requestDesign(settings, getDesignSampleRate(settings, getSampleRate()), lastRequestedDesignId + 1))
+        {
+            lastRequestedSettings = settings;
+            lastRequestedDesignId++;
+            filterDesignThread.notify();
+        }
+        else
+        {
+            processingStats.countDesignRequestDropped();
+        }
+    }
+    
+    // Pick up the newest finished design, if there is one.
+    // Ignore anything older than what is already applied (e.g. after updateFiltersImmediately()).
+    ChainCoefficients designed;
+    if (filterDesignThread.getNewestDesign(designed) && designed.designId > appliedDesignId)
+        applyChainCoefficients(designed, true);
+}
+
+void _3BandEQAudioProcessor::updateFiltersImmediately(bool shouldSmooth)
+{
+    auto settings = chainSettingsSnapshot.read();
+    settings.oversamplingOrder = getOversamplingOrder(settings.linearPhase);
+    
+    applySettingsImmediately(settings, shouldSmooth);
+}
+
+void _3BandEQAudioProcessor::applySettingsImmediately(const ChainSettings& settings, bool shouldSmooth)
+{
+    lastRequestedSettings = settings;
+    lastRequestedDesignId++;
+    
+    auto chainCoefficients = makeChainCoefficients(settings, getDesignSampleRate(settings, getSampleRate()));
+    chainCoefficients.designId = lastRequestedDesignId;
+    
+    // (The kernel is the only part of a design that allocates.)
+    // We're either not playing yet or rendering offline, so the kernel has to be in place before...
+    // ...the next block: an offline render would otherwise start out with whatever kernel the...
+    // ...convolution had before, for however long its background thread takes to load this one.
+    if (settings.linearPhase)
+        loadLinearPhaseKernel(linearPhaseConvolution, chainCoefficients, true);
+    
+    applyChainCoefficients(chainCoefficients, shouldSmooth);
+}
+
+template<typename SampleType>
+bool _3BandEQAudioProcessor::shouldSleep(const juce::AudioBuffer<SampleType>& buffer, int numInputChannels)
+{
+    const auto numSamples = buffer.getNumSamples();
+    
+    // getMagnitude() goes through FloatVectorOperations::findMinAndMax(), so this is vectorised
+    auto isInputSilent = true;
+    for (int channel = 0; channel < numInputChannels && isInputSilent; channel++)
+        isInputSilent = buffer.getMagnitude(channel, 0, numSamples) <= (SampleType)silenceThreshold;
+    
+    if (! isInputSilent)
+    {
+        numSilentInputSamples = 0;
+        isSleeping = false;
+        return false;
+    }
+    
+    // Only sleep once the tail had already died away before this block started
+    const auto hasTailDiedAway = numSilentInputSamples >= tailLengthInSamples;
+    numSilentInputSamples += numSamples;
+    
+    if (! hasTailDiedAway)
+        return false;
+    
+    // What's left in the filters is below the threshold, so throw it away and start from silence...
+    // ...when the signal comes back, rather than from state that's gone stale in the meantime
+    if (! isSleeping)
+    {
+        isSleeping = true;
+        resetProcessingState();
+    }
+    
+    return true;
+}
+
+void _3BandEQAudioProcessor::resetProcessingState()
+{
+    // (None of these allocate, so this is fine on the audio thread)
+    floatIIRChain.reset(appliedOversamplingOrder);
+    doubleIIRChain.reset(appliedOversamplingOrder);
+    linearPhaseConvolution.reset();
+}
+
+void _3BandEQAudioProcessor::reportLatency(int latency)
+{
+    if (latencyInSamples.exchange(latency) == latency)
+        return;
+    
+    // setLatencySamples() tells the host right there and then, and what the host does about it...
+    // ...(often plenty, allocations included) is no business of a realtime audio thread.
+    // Anywhere else (preparing, or rendering offline) whoever's asking wants it straight away.
+    if (isInsideRealtimeBlock)
+    {
+        triggerAsyncUpdate();
+    }
+    else
+    {
+        cancelPendingUpdate();
+        setLatencySamples(latency);
+    }
+}
+
+void _3BandEQAudioProcessor::handleAsyncUpdate()
+{
+    setLatencySamples(latencyInSamples.load());
+}
+
+void _3BandEQAudioProcessor::resetOnTransportOrBypassChange()
+{
+    auto shouldReset = wasBypassedByHost;
+    wasBypassedByHost = false;
+    
+    // Not every host has a transport (or tells us about it), so only go by it when it does
+    if (auto* playHead = getPlayHead())
+    {
+        juce::AudioPlayHead::CurrentPositionInfo position;
+        if (playHead->getCurrentPosition(position))
+        {
+            shouldReset = shouldReset || (wasTransportPlaying && ! position.isPlaying);
+            wasTransportPlaying = position.isPlaying;
+        }
+    }
+    
+    if (shouldReset)
+        resetProcessingState();
+}
+
+size_t _3BandEQAudioProcessor::getAutomationSubBlockSize() const
+{
+    // Choice 0 is "Per Block", then 16, 32, 64 and 128 samples
+    auto choice = juce::roundToInt(automationResolution->load());
+    return choice > 0 ? (size_t)(8 << choice) : 0;
+}
+
+template<typename SampleType>
+bool _3BandEQAudioProcessor::processInSubBlocks(juce::dsp::AudioBlock<SampleType>& block)
+{
+    const auto subBlockSize = getAutomationSubBlockSize();
+    auto& iirChain = getIIRChain<SampleType>();
+    
+    if (subBlockSize == 0 || isLinearPhaseActive || ! iirChain.isPrepared())
+        return false;
+    
+    auto target = chainSettingsSnapshot.read();
+    target.oversamplingOrder = getOversamplingOrder(target.linearPhase);
+    
+    // The convolution crossfades between kernels by itself, and designing those can't be done here...
+    // ...anyway. That includes a switch to linear phase whose design hasn't been applied yet.
+    if (target.linearPhase || lastRequestedSettings.linearPhase)
+        return false;
+    
+    // Nothing to spread out, or nothing that can be: the normal path handles those.
+    // (Interpolating from what the chains are running, not what was last asked for: if the design...
+    // ...thread hasn't delivered that yet, the chains aren't there.)
+    if (target == lastRequestedSettings || ! canInterpolateChainSettings(appliedSettings, target))
+        return false;
+    
+    // Whatever the design thread has finished is somewhere between the applied settings and the...
+    // ...target, which we're about to design our way to directly, so it's out of date already.
+    // It still has to come out of the queue, or the design thread stalls waiting for room.
+    // (Anything it's still working on gets an older id than ours, so updateFilters() ignores it.)
+    ChainCoefficients outOfDate;
+    filterDesignThread.getNewestDesign(outOfDate);
+    
+    // Hosts only hand us one value per parameter per block, which is where the automation has got to...
+    // ...by the end of it. Moving there in steps of a fixed number of samples, rather than once per...
+    // ...block, makes the result the same whatever the block size is, offline or in realtime.
+    const auto from = appliedSettings;
+    const auto numSamples = block.getNumSamples();
+    const auto designSampleRate = getDesignSampleRate(target, getSampleRate());
     
-    // Update the low-cut, peaking, and high-cut filters
-    updateLowCutFilter(settings);
-    updatePeakFilter(settings);
-    updateHighCutFilter(settings);
+    auto controlInterval = getSmoothingControlInterval();
+    if (controlInterval == 0)
+        controlInterval = 32;
+    
+    ChainCoefficients chainCoefficients;
+    
+    for (size_t start = 0; start < numSamples; start += subBlockSize)
+    {
+        const auto length = juce::jmin(subBlockSize, numSamples - start);
+        
+        // Each sub-block gets the settings from its end, so the last one lands right on the target.
+        // makeChainCoefficients() doesn't allocate, so this is fine on the audio thread.
+        // The sub-blocks are the steps, so the coefficients jump to each one rather than gliding.
+        auto proportion = (float)(start + length) / (float)numSamples;
+        chainCoefficients = makeChainCoefficients(interpolateChainSettings(from, target, proportion), designSampleRate);
+        setChainCoefficients(chainCoefficients, 0, 0);
+        
+        auto subBlock = block.getSubBlock(start, length);
+        iirChain.process(subBlock, appliedOversamplingOrder, controlInterval);
+    }
+    
+    // Only the slopes, bypasses and modes change the latency, and none of those did,...
+    // ...so the rest of the bookkeeping only needs doing once, for where we ended up
+    lastRequestedSettings = target;
+    chainCoefficients.designId = ++lastRequestedDesignId;
+    finishApplyingDesign(chainCoefficients);
+    // (The last sub-block's settings are the target, give or take the interpolation's rounding)
+    appliedSettings = target;
+    
+    return true;
+}
+
+size_t _3BandEQAudioProcessor::getSmoothingControlInterval() const
+{
+    // Choice 0 is "Off", then 16, 32 and 64 samples
+    auto choice = (int)coefficientSmoothing->load();
+    return choice > 0 ? (size_t)(8 << choice) : 0;
+}
+
+int _3BandEQAudioProcessor::getOversamplingOrder(bool linearPhase) const
+{
+    if (linearPhase)
+        return 0;
+    
+    // Choices are Off, 2x and 4x, i.e. orders 0, 1 and 2
+    auto* choice = isNonRealtime() ? offlineOversampling : oversampling;
+    return juce::jlimit(0, 2, juce::roundToInt(choice->load()));
+}
+
+template<typename SampleType>
+void _3BandEQAudioProcessor::processLinearPhase(juce::dsp::AudioBlock<SampleType>& block)
+{
+    if constexpr (std::is_same_v<SampleType, float>)
+    {
+        linearPhaseConvolution.process(block);
+    }
+    else
+    {
+        // Round the block to float, convolve, and widen it back again.
+        // The kernel itself is only float accurate, so nothing is lost that we had to begin with.
+        const auto numChannels = juce::jmin(block.getNumChannels(), (size_t)convolutionBuffer.getNumChannels());
+        const auto numSamples = block.getNumSamples();
+        jassert(numSamples <= (size_t)convolutionBuffer.getNumSamples());
+        
+        juce::dsp::AudioBlock<float> floatBlock(convolutionBuffer);
+        floatBlock = floatBlock.getSubsetChannelBlock(0, numChannels).getSubBlock(0, numSamples);
+        
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            const auto* source = block.getChannelPointer(channel);
+            auto* destination = floatBlock.getChannelPointer(channel);
+            
+            for (size_t n = 0; n < numSamples; n++)
+                destination[n] = (float)source[n];
+        }
+        
+        linearPhaseConvolution.process(floatBlock);
+        
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            const auto* source = floatBlock.getChannelPointer(channel);
+            auto* destination = block.getChannelPointer(channel);
+            
+            for (size_t n = 0; n < numSamples; n++)
+                destination[n] = (double)source[n];
+        }
+    }
+}
+
+ProcessingStats::Snapshot _3BandEQAudioProcessor::getProcessingStats() const
+{
+    auto snapshot = processingStats.getSnapshot();
+    snapshot.numAnalyzerSamplesDropped = leftChannelFIFO.getNumDroppedSamples() + rightChannelFIFO.getNumDroppedSamples();
+    return snapshot;
+}
+
+void _3BandEQAudioProcessor::resetProcessingStats()
+{
+    processingStats.reset();
+    leftChannelFIFO.resetNumDroppedSamples();
+    rightChannelFIFO.resetNumDroppedSamples();
+}
+
+AnalyzerChannels _3BandEQAudioProcessor::getAnalyzerChannels() const
+{
+    // Parameter choices line up with the AnalyzerChannels enum
+    return static_cast<AnalyzerChannels>(juce::jlimit(0, 3, juce::roundToInt(analyzerChannels->load())));
+}
+
+template<typename SampleType>
+void _3BandEQAudioProcessor::updateAnalyzerFIFOs(const juce::AudioBuffer<SampleType>& buffer)
+{
+    // Only feed the FIFOs the analyzer actually displays, so it only runs the FFTs it needs
+    switch ( getAnalyzerChannels() )
+    {
+        case ANALYZER_STEREO:
+            leftChannelFIFO.update(buffer);
+            // (a mono bus only has a left channel)
+            if (buffer.getNumChannels() > 1)
+                rightChannelFIFO.update(buffer);
+            break;
+        case ANALYZER_MONO:
+            leftChannelFIFO.updateWithSum(buffer, 0.5f, 0.5f);
+            break;
+        case ANALYZER_MID_SIDE:
+            leftChannelFIFO.updateWithSum(buffer, 0.5f, 0.5f);
+            rightChannelFIFO.updateWithSum(buffer, 0.5f, -0.5f);
+            break;
+        case ANALYZER_LEFT:
+            leftChannelFIFO.update(buffer);
+            break;
+    }
+}
+
+//=======================================================================================
+// Filter design thread
+//=======================================================================================
+
+bool FilterDesignThread::requestDesign(const ChainSettings& chainSettings, double sampleRate, int designId)
+{
+    return requests.push({ chainSettings, sampleRate, designId });
+}
+
+bool FilterDesignThread::getNewestDesign(ChainCoefficients& chainCoefficients)
+{
+    // Drain the queue, only the newest design is worth applying
+    bool gotDesign = false;
+    while (results.pull(chainCoefficients))
+        gotDesign = true;
+    
+    return gotDesign;
+}
+
+void FilterDesignThread::run()
+{
+    while (! threadShouldExit())
+    {
+        // Sleep until the audio thread asks for a new design
+        if (requests.getNumAvailableForReading() == 0)
+        {
+            wait(-1);
+            continue;
+        }
+        
+        // Skip straight to the newest request. Anything older is already out of date.
+        DesignRequest request;
+        while (requests.pull(request)) {}
+        
+        auto chainCoefficients = makeChainCoefficients(request.settings, request.sampleRate);
+        chainCoefficients.designId = request.designId;
+        
+        // The FIR kernel is by far the slowest part, but the audio thread carries on with the...
+        // ...old kernel (or the IIR chain) in the meantime, so nothing ever waits for it
+        if (request.settings.linearPhase)
+            loadLinearPhaseKernel(linearPhaseConvolution, chainCoefficients, false);
+        
+        // The audio thread drains this every block, so it should only ever be full if playback has stopped
+        while (! results.push(chainCoefficients))
+        {
+            if (threadShouldExit())
+                return;
+            
+            wait(5);
+        }
+    }
 }
 
 //=======================================================================================
@@ -387,33 +1531,129 @@ juce::AudioProcessorValueTreeState::ParameterLayout _3BandEQAudioProcessor::crea
                                                           "HighCut_Bypass",
                                                           false));
     
-    // Peak Frequency Parameter
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak_Freq",
-                                                           "Peak_Freq",
-                                                           juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.25f),
-                                                           750.f));
-    
-    // Peak Gain Parameter
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak_Gain",
-                                                           "Peak_Gain",
-                                                           juce::NormalisableRange<float>(-24.f, 24.f, 0.5f, 1.f),
-                                                           0.f));
-    // Peak Q Parameter
-    layout.add(std::make_unique<juce::AudioParameterFloat>("Peak_Q",
-                                                           "Peak_Q",
-                                                           juce::NormalisableRange<float>(0.1f, 10.f, 0.05f, 1.f),
-                                                           1.f));
-    
-    // Peak Bypass
-    layout.add(std::make_unique<juce::AudioParameterBool>("Peak_Bypass",
-                                                          "Peak_Bypass",
-                                                          false));
+    // Parametric Bands (Peak_ for the first one, then Peak2_ to Peak8_, see getBandParameterID()).
+    // The first band defaults to the 750 Hz bell it always was, the rest start out bypassed,...
+    // ...spread an octave and a bit apart so switching one on doesn't land it on top of another.
+    auto addBandParameters = [&layout](int band)
+    {
+        const auto defaultFreq = band == 0 ? 750.f : 60.f * std::pow(2.f, 1.25f * (float)(band - 1));
+        
+        // Peak Frequency Parameter
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, "Freq"),
+                                                               getBandParameterID(band, "Freq"),
+                                                               juce::NormalisableRange<float>(20.f, 20000.f, 1.f, 0.25f),
+                                                               std::round(defaultFreq)));
+        
+        // Peak Gain Parameter
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, "Gain"),
+                                                               getBandParameterID(band, "Gain"),
+                                                               juce::NormalisableRange<float>(-24.f, 24.f, 0.5f, 1.f),
+                                                               0.f));
+        // Peak Q Parameter
+        layout.add(std::make_unique<juce::AudioParameterFloat>(getBandParameterID(band, "Q"),
+                                                               getBandParameterID(band, "Q"),
+                                                               juce::NormalisableRange<float>(0.1f, 10.f, 0.05f, 1.f),
+                                                               1.f));
+        
+        // Peak Bypass
+        layout.add(std::make_unique<juce::AudioParameterBool>(getBandParameterID(band, "Bypass"),
+                                                              getBandParameterID(band, "Bypass"),
+                                                              band != 0));
+    };
+    
+    // Peak Type (choices line up with BandType)
+    auto addBandTypeParameter = [&layout](int band)
+    {
+        layout.add(std::make_unique<juce::AudioParameterChoice>(getBandParameterID(band, "Type"),
+                                                                getBandParameterID(band, "Type"),
+                                                                juce::StringArray { "Bell", "Low Shelf", "High Shelf", "Notch" },
+                                                                0) );
+    };
+    
+    // The first band's frequency, gain, Q and bypass are the old peak filter's, in its old place
+    addBandParameters(0);
     
     // Spectrum Analyzer Bypass
     layout.add(std::make_unique<juce::AudioParameterBool>("Analyzer_Bypass",
                                                           "Analyzer_Bypass",
                                                           true));
     
+    // Everything from here on was added later. Hosts and wrappers that find parameters by...
+    // ...their index (VST2, legacy parameter IDs) keep finding the original ones, so new...
+    // ...parameters only ever go on the end.
+    addBandTypeParameter(0);
+    for (int band = 1; band < maxNumBands; band++)
+    {
+        addBandParameters(band);
+        addBandTypeParameter(band);
+    }
+    
+    // Phase Mode (the IIR chain, or the same response as a linear phase FIR filter)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Phase_Mode",
+                                                            "Phase_Mode",
+                                                            juce::StringArray { "Minimum Phase", "Linear Phase" },
+                                                            0) );
+    
+    // Linear Phase Quality (kernel length: a better low end, at the cost of more latency)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Linear_Phase_Quality",
+                                                            "Linear_Phase_Quality",
+                                                            juce::StringArray { "Low Latency", "Balanced", "High Resolution" },
+                                                            1) );
+    
+    // Oversampling for the IIR chain, while playing in realtime...
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Oversampling",
+                                                            "Oversampling",
+                                                            juce::StringArray { "Off", "2x", "4x" },
+                                                            0) );
+    
+    // ...and while rendering offline, where there's usually CPU time to spare
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Oversampling_Offline",
+                                                            "Oversampling_Offline",
+                                                            juce::StringArray { "Off", "2x", "4x" },
+                                                            0) );
+    
+    // Coefficient Smoothing (how often the coefficients move while gliding to a new design)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Coefficient_Smoothing",
+                                                            "Coefficient_Smoothing",
+                                                            juce::StringArray { "Off", "16 samples", "32 samples", "64 samples" },
+                                                            2) );
+    
+    // Automation Resolution (how often parameter changes reach the filters within a block)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Automation_Resolution",
+                                                            "Automation_Resolution",
+                                                            juce::StringArray { "Per Block", "16 samples", "32 samples", "64 samples", "128 samples" },
+                                                            0) );
+    
+    // Spectrum Analyzer Channels (what the analyzer looks at, see AnalyzerChannels)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer_Channels",
+                                                            "Analyzer_Channels",
+                                                            juce::StringArray { "Left + Right", "Mono", "Mid/Side", "Left" },
+                                                            0) );
+    
+    // Spectrum Analyzer Resolution (FFT size)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer_Resolution",
+                                                            "Analyzer_Resolution",
+                                                            juce::StringArray { "2048", "4096", "8192" },
+                                                            0) );
+    
+    // Spectrum Analyzer Overlap (how much consecutive FFT windows overlap, which sets the hop size)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer_Overlap",
+                                                            "Analyzer_Overlap",
+                                                            juce::StringArray { "0%", "50%", "75%" },
+                                                            2) );
+    
+    // Spectrum Analyzer Averaging (how quickly the trace follows the signal)
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer_Averaging",
+                                                            "Analyzer_Averaging",
+                                                            juce::StringArray { "Off", "Fast", "Medium", "Slow" },
+                                                            1) );
+    
+    // Spectrum Analyzer Peak Hold
+    layout.add(std::make_unique<juce::AudioParameterChoice>("Analyzer_Peak_Hold",
+                                                            "Analyzer_Peak_Hold",
+                                                            juce::StringArray { "Off", "Decay", "Max Hold" },
+                                                            0) );
+    
     return layout;
 }
 
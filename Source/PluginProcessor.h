@@ -10,7 +10,13 @@
 
 #include <JuceHeader.h>
 
+#include "BiquadCascade.h"
+#include "ProcessingStats.h"
+
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <cstring>
 
 enum Channel
 {
@@ -18,6 +24,22 @@ enum Channel
     RIGHT   // 1
 };
 
+// What the spectrum analyzer looks at.
+// The left channel FIFO carries the first trace and the right channel FIFO the second, if there is one.
+enum AnalyzerChannels
+{
+    ANALYZER_STEREO,    // Left and right
+    ANALYZER_MONO,      // (L + R) / 2
+    ANALYZER_MID_SIDE,  // (L + R) / 2 and (L - R) / 2
+    ANALYZER_LEFT       // Left only
+};
+
+// Returns true if the analyzer mode needs the right channel FIFO (and its FFTs) at all
+inline bool analyzerUsesSecondTrace(AnalyzerChannels analyzerChannels)
+{
+    return analyzerChannels == ANALYZER_STEREO || analyzerChannels == ANALYZER_MID_SIDE;
+}
+
 // FIFO queue for the SingleChannelSampleFifo class
 template<typename T>
 struct Fifo
@@ -85,7 +107,43 @@ private:
     juce::AbstractFifo fifo {Capacity};
 };
 
-// Converts some-number-of-samples from a host buffer into a FIFO queue of fixed-size blocks
+// Lock-free hand-over of the newest value from one writer thread to one reader thread.
+// The writer fills getWriteBuffer() and calls publish(). The reader calls update(), and then...
+// ...reads getReadBuffer(), which stays untouched by the writer until the next update().
+template<typename T>
+struct TripleBuffer
+{
+    T& getWriteBuffer() { return buffers[writeIndex]; }
+    
+    void publish()
+    {
+        // Swap our freshly written buffer with the spare one, flagging it as new
+        writeIndex = spare.exchange(writeIndex | newDataFlag) & indexMask;
+    }
+    
+    // Returns true if something new was published since the last call
+    bool update()
+    {
+        if ((spare.load() & newDataFlag) == 0)
+            return false;
+        
+        readIndex = spare.exchange(readIndex) & indexMask;
+        return true;
+    }
+    
+    const T& getReadBuffer() const { return buffers[readIndex]; }
+private:
+    static constexpr int newDataFlag = 4;
+    static constexpr int indexMask = 3;
+    
+    std::array<T, 3> buffers;
+    int writeIndex {0}, readIndex {1};
+    std::atomic<int> spare {2};
+};
+
+// Single-producer/single-consumer ring of samples from one channel of the host buffer.
+// The audio thread writes whole blocks with vector copies, and the GUI reads the samples...
+// ...straight out of the ring (as up to two contiguous spans) without copying any buffers around.
 template<typename BlockType>
 struct SingleChannelSampleFifo
 {
@@ -94,16 +152,62 @@ struct SingleChannelSampleFifo
         prepared.set(false);
     }
     
-    void update(const BlockType& buffer)
+    // (double precision buffers get rounded to float on the way in, the analyzer doesn't need more)
+    template<typename SampleType>
+    void update(const juce::AudioBuffer<SampleType>& buffer)
     {
+        // Nobody is looking at the analyzer, so don't bother feeding it
+        if (! consumerAttached.get())
+            return;
+        
         jassert(prepared.get());
         jassert(buffer.getNumChannels() > channelToUse);
         auto* channelPtr = buffer.getReadPointer(channelToUse);
         
-        for (int i = 0; i < buffer.getNumSamples(); i++)
+        writeSamples(buffer.getNumSamples(), [channelPtr](float* destination, int offset, int numSamples)
         {
-            pushNextSampleIntoFifo(channelPtr[i]);
+            if constexpr (std::is_same_v<SampleType, float>)
+            {
+                juce::FloatVectorOperations::copy(destination, channelPtr + offset, numSamples);
+            }
+            else
+            {
+                for (int i = 0; i < numSamples; i++)
+                    destination[i] = (float)channelPtr[offset + i];
+            }
+        });
+    }
+    
+    // Same as update(), but writes leftGain * left + rightGain * right instead of a single channel...
+    // ...e.g. (L + R) / 2 for a mono sum, or (L - R) / 2 for the side signal.
+    // The sum is worked out straight into the ring, in one (vectorizable) pass.
+    template<typename SampleType>
+    void updateWithSum(const juce::AudioBuffer<SampleType>& buffer, float leftGain, float rightGain)
+    {
+        if (! consumerAttached.get())
+            return;
+        
+        jassert(prepared.get());
+        auto* leftPtr = buffer.getReadPointer(Channel::LEFT);
+        
+        // A mono bus has no right channel, so the sum comes down to a scaled left channel
+        if (buffer.getNumChannels() < 2)
+        {
+            writeSamples(buffer.getNumSamples(), [leftPtr, leftGain, rightGain](float* destination, int offset, int numSamples)
+            {
+                for (int i = 0; i < numSamples; i++)
+                    destination[i] = (leftGain + rightGain) * (float)leftPtr[offset + i];
+            });
+            return;
         }
+        
+        auto* rightPtr = buffer.getReadPointer(Channel::RIGHT);
+        
+        writeSamples(buffer.getNumSamples(), [leftPtr, rightPtr, leftGain, rightGain](float* destination, int offset, int numSamples)
+        {
+            for (int i = 0; i < numSamples; i++)
+                destination[i] = leftGain * (float)leftPtr[offset + i] + rightGain * (float)rightPtr[offset + i];
+        });
     }
     
     void prepare(int bufferSize)
@@ -111,43 +215,107 @@ struct SingleChannelSampleFifo
         prepared.set(false);
         size.set(bufferSize);
         
-        bufferToFill.setSize(1,             // channel
-                             bufferSize,    // number of samples
-                             false,         // keep existing content?
-                             true,          // clear extra space?
-                             true);         // avoid reallocating?
-        audioBufferFifo.prepare(1, bufferSize);
-        fifoIndex = 0;
+        // The ring is only allocated once somebody reads from it (see setConsumerAttached()),...
+        // ...since most instances in a big session never have their editor opened
+        if (! ring.empty())
+            allocateRing();
+        
         prepared.set(true);
     }
     //===========================================================================
-    int getNumCompleteBuffersAvailable() const { return audioBufferFifo.getNumAvailableForReading(); }
+    int getNumSamplesAvailable() const { return fifo.getNumReady(); }
     bool isPrepared() const { return prepared.get(); }
     int getSize() const { return size.get(); }
+    // How many samples have been dropped because the ring was full
+    juce::int64 getNumDroppedSamples() const { return numDroppedSamples.load(std::memory_order_relaxed); }
+    void resetNumDroppedSamples() { numDroppedSamples.store(0, std::memory_order_relaxed); }
     //===========================================================================
-    bool getAudioBuffer(BlockType& buffer) { return audioBufferFifo.pull(buffer); }
-private:
-    Channel channelToUse;
-    int fifoIndex = 0;
-    Fifo<BlockType> audioBufferFifo;
-    BlockType bufferToFill;
-    juce::Atomic<bool> prepared = false;
-    juce::Atomic<int> size = 0;
-    
-    void pushNextSampleIntoFifo(float sample)
+    // Lets the GUI tell us whether anyone is reading from this FIFO.
+    // While nobody is (editor closed, or analyzer switched off), update() returns straight away.
+    // Called from the message thread.
+    void setConsumerAttached(bool isAttached)
     {
-        if (fifoIndex == bufferToFill.getNumSamples())
+        // Nothing is writing to the ring while nobody is attached, so it's safe to allocate it here
+        if (isAttached && ! consumerAttached.get() && ring.size() != (size_t)getCapacity())
+            allocateRing();
+        
+        consumerAttached.set(isAttached);
+    }
+    bool isConsumerAttached() const { return consumerAttached.get(); }
+    // Frees the ring until the next prepare(), unless somebody is reading from it right now...
+    // ...(then it stays, the editor has it open)
+    void release()
+    {
+        prepared.set(false);
+        
+        if (! consumerAttached.get())
         {
-            auto ok = audioBufferFifo.push(bufferToFill);
-            
-            juce::ignoreUnused(ok);
-            
-            fifoIndex = 0;
+            const juce::ScopedLock sl(ringLock);
+            std::vector<float>().swap(ring);
+            fifo.reset();
         }
+    }
+    //===========================================================================
+    // Hands the oldest numSamples samples to callback(const float* samples, int numSamples)...
+    // ...as one or two contiguous spans, then frees them up for the audio thread
+    template<typename Callback>
+    void readSamples(int numSamples, Callback&& callback)
+    {
+        // (The reader is an analyzer worker thread, which can't be allowed to read while...
+        // ...the message thread reallocates the ring, see allocateRing())
+        const juce::ScopedLock sl(ringLock);
+        auto read = fifo.read(numSamples);
+        
+        if (read.blockSize1 > 0)
+            callback(ring.data() + read.startIndex1, read.blockSize1);
+        if (read.blockSize2 > 0)
+            callback(ring.data() + read.startIndex2, read.blockSize2);
+    }
+private:
+    // Helper function to reserve numSamples in the ring and have writeSpan(destination, offset, numSamples)...
+    // ...fill them in, as one or two contiguous spans (offset counts from the start of the block)
+    template<typename WriteFunction>
+    void writeSamples(int numSamples, WriteFunction&& writeSpan)
+    {
+        // If the GUI has fallen behind and the ring is full, the newest samples are dropped
+        auto write = fifo.write(numSamples);
         
-        bufferToFill.setSample(0, fifoIndex, sample);
-        fifoIndex++;
+        if (write.blockSize1 > 0)
+            writeSpan(ring.data() + write.startIndex1, 0, write.blockSize1);
+        if (write.blockSize2 > 0)
+            writeSpan(ring.data() + write.startIndex2, write.blockSize1, write.blockSize2);
+        
+        if (auto numDropped = numSamples - write.blockSize1 - write.blockSize2; numDropped > 0)
+            numDroppedSamples.fetch_add(numDropped, std::memory_order_relaxed);
     }
+    
+    // Leave plenty of room for the GUI to fall behind by a few frames
+    int getCapacity() const { return juce::jmax(minimumCapacity, size.get() * 4); }
+    
+    // Only ever called while the audio thread isn't writing (before playback starts, or before a...
+    // ...consumer attaches), but the analyzer worker may still be reading, hence the lock
+    void allocateRing()
+    {
+        const juce::ScopedLock sl(ringLock);
+        auto capacity = getCapacity();
+        if (ring.size() != (size_t)capacity)
+            ring.assign((size_t)capacity, 0.f);
+        
+        fifo.setTotalSize(capacity);
+        fifo.reset();
+    }
+    
+    static constexpr int minimumCapacity = 32768;
+    
+    Channel channelToUse;
+    std::vector<float> ring;
+    juce::AbstractFifo fifo {minimumCapacity};
+    // Held by the reader, and by anything that reallocates or resets the ring. Never by the audio thread.
+    juce::CriticalSection ringLock;
+    juce::Atomic<bool> prepared = false;
+    juce::Atomic<bool> consumerAttached = false;
+    juce::Atomic<int> size = 0;
+    std::atomic<juce::int64> numDroppedSamples {0};
 };
 
 // Filter slope enum
@@ -159,98 +327,216 @@ enum Slope
     SLOPE_48
 };
 
+// Parametric band type enum (a notch ignores its band's gain)
+enum BandType
+{
+    BAND_BELL,
+    BAND_LOW_SHELF,
+    BAND_HIGH_SHELF,
+    BAND_NOTCH
+};
+
+// Up to this many parametric bands sit between the cut filters.
+// Band 1 is the original peak band, the others start out bypassed.
+constexpr int maxNumBands = 8;
+
+// The settings of one parametric band
+struct BandSettings
+{
+    BandType type {BandType::BAND_BELL};
+    float freq {0}, gain_dB {0}, Q {1.f};
+    bool bypass {false};
+    
+    bool operator==(const BandSettings& other) const
+    {
+        return type == other.type && freq == other.freq && gain_dB == other.gain_dB
+            && Q == other.Q && bypass == other.bypass;
+    }
+};
+
+// Parameter ID for one of a band's settings, e.g. getBandParameterID(0, "Freq") is "Peak_Freq"...
+// ...(band 1 keeps the IDs the peak band always had), and getBandParameterID(1, "Freq") is "Peak2_Freq"
+juce::String getBandParameterID(int band, const juce::String& name);
+
 // Set up a struct to contain all parameter settings in the chain
 struct ChainSettings
 {
     float lowCutFreq {0}, highCutFreq {0};
     Slope lowCutSlope {Slope::SLOPE_12}, highCutSlope {Slope::SLOPE_12};
-    float peakFreq {0}, peakGain_dB {0}, peakQ {1.f};
+    std::array<BandSettings, maxNumBands> bands;
     
-    bool lowCutBypass {false}, highCutBypass {false}, peakBypass {false};
+    bool lowCutBypass {false}, highCutBypass {false};
+    
+    // Linear phase mode runs the whole chain as one FIR filter instead, see makeLinearPhaseKernel()
+    bool linearPhase {false};
+    int linearPhaseQuality {0};
+    
+    // The IIR chain runs at 2^oversamplingOrder times the host sample rate (0 = no oversampling).
+    // Which parameter this comes from depends on the processor, see getOversamplingOrder().
+    int oversamplingOrder {0};
+    
+    // Lets us detect when any parameter in the chain has actually changed
+    bool operator==(const ChainSettings& other) const
+    {
+        return lowCutFreq    == other.lowCutFreq    && highCutFreq   == other.highCutFreq
+            && lowCutSlope   == other.lowCutSlope   && highCutSlope  == other.highCutSlope
+            && bands         == other.bands
+            && lowCutBypass  == other.lowCutBypass  && highCutBypass == other.highCutBypass
+            && linearPhase   == other.linearPhase   && linearPhaseQuality == other.linearPhaseQuality
+            && oversamplingOrder == other.oversamplingOrder;
+    }
+    bool operator!=(const ChainSettings& other) const { return ! (*this == other); }
 };
 
-// Helper function to return all parameter values from the APVTS as a ChainSettings struct
-ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& APVTS);
-
-// Shorthand for basic IIR filter. 12dB/oct by default.
-using Filter = juce::dsp::IIR::Filter<float>;
-// Sub-processing chain for our Low/High Cut filters, consisting of FOUR 12dB/oct filters.
-using CutFilter = juce::dsp::ProcessorChain<Filter, Filter, Filter, Filter>;
-// Our single-channel processing chain: (Low)Cut Filter, Peaking Filter, (High)Cut Filter.
-using MonoChain = juce::dsp::ProcessorChain<CutFilter, Filter, CutFilter>;
-
-// Define enum to simplify accessing each link in the processing chain
-enum ChainPositions{
-    LowCut,     //0
-    Peak,       //1
-    HighCut     //2
+// Raw parameter pointers for the chain, looked up once at construction...
+// ...so the audio thread never has to do string-keyed getRawParameterValue() lookups
+struct ChainParameters
+{
+    ChainParameters(juce::AudioProcessorValueTreeState& APVTS);
+    
+    std::atomic<float> *lowCutFreq, *lowCutSlope, *lowCutBypass,
+                       *highCutFreq, *highCutSlope, *highCutBypass,
+                       *phaseMode, *linearPhaseQuality;
+    
+    struct BandParameters
+    {
+        std::atomic<float> *type, *freq, *gain, *Q, *bypass;
+    };
+    std::array<BandParameters, maxNumBands> bands;
 };
 
-//
-using Coefficients = Filter::CoefficientsPtr;
-void updateCoefficients(Coefficients& old, const Coefficients& replacement);
+// Helper function to return all parameter values from the cached pointers as a ChainSettings struct
+ChainSettings getChainSettings(const ChainParameters& chainParameters);
 
-Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate);
+// Whether two sets of settings only differ in their frequencies, gain and Q, so the chain...
+// ...can move smoothly from one to the other. Anything else (slopes, bypasses, modes) switches.
+bool canInterpolateChainSettings(const ChainSettings& from, const ChainSettings& to);
+// Moves the frequencies, gain and Q a proportion (0 to 1) of the way from one set of settings to another.
+// Frequencies and Q move geometrically, like they do on their skewed parameter ranges.
+ChainSettings interpolateChainSettings(const ChainSettings& from, const ChainSettings& to, float proportion);
 
-// Helper function to update a filter component (one of the four 12dB/oct "sub"-filters that...
-// ...make up the low- and high-cut filters in our chain).
-template<int FilterComponentIndex, typename ChainType, typename CoefficientType>
-void updateFilterComponent(ChainType& chain, CoefficientType& lowCutFilterCoefficients)
+// A packed copy of the chain's parameters, rebuilt whenever one of them changes.
+// Reading the parameters one by one can tear, e.g. pick up a new LowCut_Freq with the old...
+// ...LowCut_Slope, or a half-restored preset. This is a seqlock, so read() always returns...
+// ...one consistent set, at the cost of a few loads. It only retries if it overlaps a write.
+struct ChainSettingsSnapshot : juce::AudioProcessorValueTreeState::Listener
 {
-    // Pass the current filter-chain parameter settings to the filters as coefficients
-    updateCoefficients( chain.template get<FilterComponentIndex>().coefficients,
-                        lowCutFilterCoefficients[FilterComponentIndex] );
-    // Stop bypassing filter components as required
-    chain.template setBypassed<FilterComponentIndex>(false);
+    ChainSettingsSnapshot(juce::AudioProcessorValueTreeState& APVTS);
+    ~ChainSettingsSnapshot() override;
+    
+    // Safe to call from any thread (audio thread included)
+    ChainSettings read() const noexcept;
+    // Goes up by one every time any of the chain's parameters change
+    juce::uint32 getVersion() const noexcept { return sequence.load(std::memory_order_acquire) / 2; }
+    
+    // Holds back the rebuild while lots of parameters change at once (e.g. a preset recall),...
+    // ...and rebuilds the copy once at the end. Until then, readers keep getting the old settings.
+    struct ScopedBatch
+    {
+        explicit ScopedBatch(ChainSettingsSnapshot& s) : snapshot(s) { snapshot.batchDepth++; }
+        ~ScopedBatch() { snapshot.endBatch(); }
+        
+        ChainSettingsSnapshot& snapshot;
+        JUCE_DECLARE_NON_COPYABLE(ScopedBatch)
+    };
+private:
+    // Called from whichever thread changed the parameter
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    void write(const ChainSettings& settings) noexcept;
+    
+    juce::AudioProcessorValueTreeState& APVTS;
+    const ChainParameters parameters;
+    
+    static_assert(std::is_trivially_copyable_v<ChainSettings>, "ChainSettings gets copied word by word");
+    static constexpr size_t numWords = (sizeof(ChainSettings) + sizeof(juce::uint32) - 1) / sizeof(juce::uint32);
+    
+    // Odd while a write is in progress
+    std::atomic<juce::uint32> sequence {0};
+    // The settings themselves, as relaxed atomic words so a read that races a write is still...
+    // ...well defined (it just gets thrown away). Only one parameter gets written at a time.
+    std::array<std::atomic<juce::uint32>, numWords> words {};
+    juce::SpinLock writeLock;
+    
+    // Number of ScopedBatches in progress
+    std::atomic<int> batchDepth {0};
+    void endBatch();
+};
+
+// Shorthand for JUCE's (reference-counted) IIR filter coefficients, as returned by its filter design functions.
+// Always double precision, see DesignedCoefficients.
+using Coefficients = juce::dsp::IIR::Coefficients<double>::Ptr;
+
+// The sample rate the chain gets designed for, once the oversampling is taken into account
+inline double getDesignSampleRate(const ChainSettings& chainSettings, double hostSampleRate)
+{
+    return hostSampleRate * (1 << chainSettings.oversamplingOrder);
 }
 
-// Helper function to update a cut filter
-template<typename ChainType, typename CoefficientType>
-void updateCutFilter(ChainType& lowCutFilter,
-                     const CoefficientType& lowCutFilterCoefficients,
-                     const Slope& lowCutFilterSlope)
+// Fixed-size storage for every coefficient in the chain.
+// This is what gets handed over from the filter design thread to the audio thread.
+struct ChainCoefficients
 {
-    // Bypass each 12dB/oct filter component in the low cut filter...
-    lowCutFilter.template setBypassed<0>(true);
-    lowCutFilter.template setBypassed<1>(true);
-    lowCutFilter.template setBypassed<2>(true);
-    lowCutFilter.template setBypassed<3>(true);
-
-    // ...Then update/re-enable them as demanded by the current chain settings
-    switch( lowCutFilterSlope )
-    {
-        // If chain settings specify 8th order (48 dB/oct) slope,
-        //   turn on all four 12 dB/oct filters. (indeces 0,1,2,3)
-        // If chain settings specify 6th order (36 dB/oct) slope,
-        //   turn on three of the four 12 dB/oct filters. (indeces 0,1,2)
-        // and so on...
-        case SLOPE_48:
-        {
-            updateFilterComponent<3>(lowCutFilter, lowCutFilterCoefficients);
-        }
-        case SLOPE_36:
-        {
-            updateFilterComponent<2>(lowCutFilter, lowCutFilterCoefficients);
-        }
-        case SLOPE_24:
-        {
-            updateFilterComponent<1>(lowCutFilter, lowCutFilterCoefficients);
-        }
-        case SLOPE_12:
-        {
-            updateFilterComponent<0>(lowCutFilter, lowCutFilterCoefficients);
-        }
-    }
+    ChainSettings settings;
+    double sampleRate {0};
+    int designId {0};
+    
+    // (Bypassed bands don't get designed)
+    std::array<DesignedCoefficients, maxNumBands> bands;
+    std::array<DesignedCoefficients, 4> lowCut, highCut;
+};
+
+// JUCE's design for the first band, as a bell (see designBand() for the one the chain uses)
+Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate);
+
+// The same designs as JUCE's IIR::Coefficients::makePeakFilter(), makeLowShelf(), makeHighShelf(),...
+// ...makeNotch(), makeHighPass() and makeLowPass(), but written straight into a DesignedCoefficients,...
+// ...so they never allocate
+DesignedCoefficients designPeakFilter(double sampleRate, double frequency, double Q, double gainFactor);
+DesignedCoefficients designLowShelf(double sampleRate, double frequency, double Q, double gainFactor);
+DesignedCoefficients designHighShelf(double sampleRate, double frequency, double Q, double gainFactor);
+DesignedCoefficients designNotch(double sampleRate, double frequency, double Q);
+DesignedCoefficients designHighPass(double sampleRate, double frequency, double Q);
+DesignedCoefficients designLowPass(double sampleRate, double frequency, double Q);
+
+// Designs one parametric band, whatever its type
+DesignedCoefficients designBand(const BandSettings& band, double sampleRate);
+
+// Designs every filter in the chain.
+// This gives the same coefficients as JUCE's design functions (see makePeakFilter(), makeLowCutFilter()...
+// ...and makeHighCutFilter()), but doesn't allocate, so it's safe to call on the audio thread too.
+ChainCoefficients makeChainCoefficients(const ChainSettings& chainSettings, double sampleRate);
+
+// Helper function to multiply the squared magnitude response of every non-bypassed filter...
+// ...in the chain into magnitudesSquared[], at each of the table's frequencies
+void multiplyChainSquaredMagnitudes(const ChainCoefficients& chainCoefficients,
+                                    const FrequencyResponseTable& responseTable,
+                                    double* magnitudesSquared);
+
+// Helper function to estimate how long the chain keeps ringing once its input stops, in samples at...
+// ...the rate it was designed for. Adds up the decay time of every non-bypassed section.
+double getChainTailLengthInSamples(const ChainCoefficients& chainCoefficients, double decayFactor);
+
+// Linear phase kernel length for each quality setting (Low Latency, Balanced, High Resolution).
+// Longer kernels resolve the low cut better, but delay the signal by half their length.
+inline int getLinearPhaseKernelOrder(int linearPhaseQuality)
+{
+    static constexpr int kernelOrders[] { 11, 13, 14 };
+    return kernelOrders[juce::jlimit(0, 2, linearPhaseQuality)];
 }
 
+// Designs a linear phase FIR filter with the same magnitude response as the whole chain.
+// The kernel is symmetric around its centre, so it delays everything by half its length.
+// This allocates and runs an FFT, so keep it off the audio thread!
+juce::AudioBuffer<float> makeLinearPhaseKernel(const ChainCoefficients& chainCoefficients);
+
 inline auto makeLowCutFilter(const ChainSettings& chainSettings, double sampleRate)
 {
     // Calculate filter order (2, 4, 6, or 8) from filter slope parameters (0, 1, 2, or 3)
     auto lowCutFilterOrder = 2 * (chainSettings.lowCutSlope + 1);
     // Calculate and return the low cut filter coefficients
-    return juce::dsp::FilterDesign<float>::designIIRHighpassHighOrderButterworthMethod(chainSettings.lowCutFreq,
-                                                                                       sampleRate,
-                                                                                       lowCutFilterOrder);
+    return juce::dsp::FilterDesign<double>::designIIRHighpassHighOrderButterworthMethod(chainSettings.lowCutFreq,
+                                                                                        sampleRate,
+                                                                                        lowCutFilterOrder);
 }
 
 inline auto makeHighCutFilter(const ChainSettings& chainSettings, double sampleRate)
@@ -258,15 +544,419 @@ inline auto makeHighCutFilter(const ChainSettings& chainSettings, double sampleR
     // Calculate filter order (2, 4, 6, or 8) from filter slope parameters (0, 1, 2, or 3)
     auto highCutFilterOrder = 2 * (chainSettings.highCutSlope + 1);
     // Calculate and return the high cut filter coefficients
-    return juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(chainSettings.highCutFreq,
-                                                                                      sampleRate,
-                                                                                      highCutFilterOrder);
+    return juce::dsp::FilterDesign<double>::designIIRLowpassHighOrderButterworthMethod(chainSettings.highCutFreq,
+                                                                                       sampleRate,
+                                                                                       highCutFilterOrder);
 }
 
+// juce::dsp::Convolution only handles mono and stereo, so this runs one of them per pair of channels.
+// They all run the same (mono) kernel.
+struct MultichannelConvolution
+{
+    // Must be called off the audio thread, this allocates.
+    // Until there's a kernel to load it only remembers the spec, so instances that never go...
+    // ...linear phase don't pay for the convolutions at all.
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    // Can be called from any thread except the audio thread. The first kernel creates the convolutions.
+    // The convolutions load the kernel in the background and crossfade over to it by themselves.
+    void loadImpulseResponse(const juce::AudioBuffer<float>& kernel, double kernelSampleRate);
+    // Same again, except the kernel is already the one in use when this returns: no background...
+    // ...loading and no crossfade. That means preparing the convolutions again (which clears them),...
+    // ...so this is for before playback starts, and for offline rendering, where the output...
+    // ...mustn't depend on how quickly some other thread gets round to the kernel.
+    void loadImpulseResponseNow(const juce::AudioBuffer<float>& kernel, double kernelSampleRate);
+    
+    void reset() noexcept;
+    void process(juce::dsp::AudioBlock<float>& block) noexcept;
+private:
+    // Creates (or re-prepares) a convolution for every pair of channels. Call with the lock held.
+    void prepareConvolutions();
+    
+    // Stops prepare() and loadImpulseResponse() getting in each other's way. Never taken on the audio thread.
+    juce::CriticalSection lock;
+    juce::dsp::ProcessSpec preparedSpec {};
+    bool isPrepared {false};
+    
+    // Every instance's convolutions load their kernels on the same background thread,...
+    // ...rather than each convolution starting a thread of its own
+    struct SharedMessageQueue { juce::dsp::ConvolutionMessageQueue queue; };
+    // (Declared before the convolutions, so it outlives them)
+    std::unique_ptr<juce::SharedResourcePointer<SharedMessageQueue>> messageQueue;
+    std::vector<std::unique_ptr<juce::dsp::Convolution>> convolutions;
+    // Set once the convolutions exist. The kernel reaches the audio thread through the design FIFO...
+    // ...after they're created, but reset() can come at any time, so it checks this first.
+    std::atomic<bool> hasConvolutions {false};
+    
+    // The newest kernel, so convolutions created in prepare() can start with it right away
+    juce::AudioBuffer<float> currentKernel;
+    double currentKernelSampleRate {0};
+};
+
+// Background thread that turns ChainSettings into ChainCoefficients, so that...
+// ...the designs (tan() and cos() for every section) stay off the audio thread.
+// Requests and results are passed through lock-free FIFOs of preallocated storage.
+// In linear phase mode it also designs the FIR kernel, and hands it to the convolution...
+// ...(which loads it in the background and crossfades over to it) before passing on the result.
+struct FilterDesignThread : juce::Thread
+{
+    FilterDesignThread(MultichannelConvolution& convolution) :
+    juce::Thread("3BandEQ Filter Design"),
+    linearPhaseConvolution(convolution)
+    {
+    }
+    ~FilterDesignThread() override { stopThread(1000); }
+    
+    // Called from the audio thread. Returns false if the request queue is full.
+    bool requestDesign(const ChainSettings& chainSettings, double sampleRate, int designId);
+    // Called from the audio thread. Returns true if any designs were ready, and leaves the newest in chainCoefficients
+    bool getNewestDesign(ChainCoefficients& chainCoefficients);
+    
+    void run() override;
+private:
+    struct DesignRequest
+    {
+        ChainSettings settings;
+        double sampleRate {0};
+        int designId {0};
+    };
+    
+    Fifo<DesignRequest> requests;
+    Fifo<ChainCoefficients> results;
+    
+    MultichannelConvolution& linearPhaseConvolution;
+};
+
+// Helper function to design the linear phase kernel for a chain design and hand it to the convolution,...
+// ...either to crossfade over to in the background, or (shouldLoadNow) to use from the very next block
+void loadLinearPhaseKernel(MultichannelConvolution& convolution, const ChainCoefficients& chainCoefficients, bool shouldLoadNow);
+
+// Our processing chain for all channels at once: (Low)Cut Filter, Parametric Bands, (High)Cut Filter.
+// Each cut filter only runs as many 12dB/oct sections as its slope needs.
+template<typename SampleType>
+struct SIMDChain
+{
+    using Register = SIMDRegister<SampleType>;
+    
+    SIMDBiquadCascade<SampleType, 4> lowCut;
+    // One bank for every parametric band. The bands that aren't bypassed are packed into its first...
+    // ...sections, in order, so bypassed bands cost nothing. (The bands are all in series, so their...
+    // ...order doesn't change the result.)
+    SIMDBiquadCascade<SampleType, maxNumBands> bands;
+    SIMDBiquadCascade<SampleType, 4> highCut;
+    
+    // Moves every filter towards a new design over numSteps control steps (0 means jump straight there)
+    void setTargetCoefficients(const ChainCoefficients& chainCoefficients, int numSteps)
+    {
+        const auto& chainSettings = chainCoefficients.settings;
+        
+        // A new glide takes its first step a whole control interval from now
+        samplesSinceLastStep = 0;
+        
+        // Update the low-cut and high-cut filters.
+        // A cut filter uses one 12 dB/oct section per step of slope.
+        // Set the targets BEFORE changing the number of active sections, so newly enabled sections...
+        // ...jump to their coefficients instead of gliding from an old design.
+        for (size_t i = 0; i < 4; i++)
+        {
+            lowCut.setTargetCoefficients(i, chainCoefficients.lowCut[i], numSteps);
+            highCut.setTargetCoefficients(i, chainCoefficients.highCut[i], numSteps);
+        }
+        
+        lowCut.setNumActiveSections(getNumLowCutSections(chainSettings));
+        highCut.setNumActiveSections(getNumHighCutSections(chainSettings));
+        
+        // Update the parametric bands.
+        // Bypassing a band moves every band after it to another section, and their state and...
+        // ...coefficients mean nothing there, so then the whole bank starts over from silence.
+        const auto newActiveBands = getActiveBands(chainSettings);
+        const auto bandsMoved = newActiveBands != activeBands;
+        size_t numActiveBands = 0;
+        
+        if (bandsMoved)
+            bands.reset();
+        
+        for (size_t band = 0; band < (size_t)maxNumBands; band++)
+        {
+            if (newActiveBands[band])
+                bands.setTargetCoefficients(numActiveBands++, chainCoefficients.bands[band], bandsMoved ? 0 : numSteps);
+        }
+        
+        bands.setNumActiveSections(numActiveBands);
+        activeBands = newActiveBands;
+    }
+    
+    // Whether these settings switch any sections on or off (a bypass or a slope change).
+    // That can't glide like a coefficient change: the sections switched on start from silence.
+    bool wouldChangeActiveSections(const ChainSettings& chainSettings) const
+    {
+        return lowCut.getNumActiveSections() != getNumLowCutSections(chainSettings)
+            || activeBands != getActiveBands(chainSettings)
+            || highCut.getNumActiveSections() != getNumHighCutSections(chainSettings);
+    }
+    
+    void reset()
+    {
+        lowCut.reset();
+        bands.reset();
+        highCut.reset();
+        samplesSinceLastStep = 0;
+    }
+    
+    bool isSmoothing() const
+    {
+        return lowCut.isSmoothing() || bands.isSmoothing() || highCut.isSmoothing();
+    }
+    
+    // While the coefficients are gliding, they move one step every controlInterval samples.
+    // The count carries over from one call to the next, so the glide takes just as long...
+    // ...however the calls split the samples up.
+    void process(Register* samples, size_t numSamples, size_t controlInterval) noexcept
+    {
+        jassert(controlInterval > 0);
+        
+        while (numSamples > 0 && isSmoothing())
+        {
+            // (If the interval got shorter in the middle of a step, finish it on the next sample)
+            auto samplesUntilStep = samplesSinceLastStep < controlInterval ? controlInterval - samplesSinceLastStep : 1;
+            auto numSubBlockSamples = juce::jmin(samplesUntilStep, numSamples);
+            processSubBlock(samples, numSubBlockSamples);
+            
+            samplesSinceLastStep += numSubBlockSamples;
+            if (samplesSinceLastStep >= controlInterval)
+            {
+                lowCut.advanceCoefficients();
+                bands.advanceCoefficients();
+                highCut.advanceCoefficients();
+                samplesSinceLastStep = 0;
+            }
+            
+            samples += numSubBlockSamples;
+            numSamples -= numSubBlockSamples;
+        }
+        
+        if (numSamples > 0)
+            processSubBlock(samples, numSamples);
+    }
+private:
+    void processSubBlock(Register* samples, size_t numSamples) noexcept
+    {
+        lowCut.process(samples, numSamples);
+        bands.process(samples, numSamples);
+        highCut.process(samples, numSamples);
+    }
+    
+    static size_t getNumLowCutSections(const ChainSettings& s) { return s.lowCutBypass ? 0 : (size_t)s.lowCutSlope + 1; }
+    static size_t getNumHighCutSections(const ChainSettings& s) { return s.highCutBypass ? 0 : (size_t)s.highCutSlope + 1; }
+    
+    using ActiveBands = std::bitset<(size_t)maxNumBands>;
+    static ActiveBands getActiveBands(const ChainSettings& s)
+    {
+        ActiveBands active;
+        for (size_t band = 0; band < (size_t)maxNumBands; band++)
+            active[band] = ! s.bands[band].bypass;
+        return active;
+    }
+    
+    // Which bands the bank's active sections belong to right now
+    ActiveBands activeBands;
+    
+    // How far we are into the current glide step
+    size_t samplesSinceLastStep {0};
+};
+
+// The whole IIR processing path at one sample precision:...
+// ...the SIMD chains, their interleaving buffer, and the 2x and 4x oversamplers around them.
+// Channels are processed in groups of one SIMD register each, so any number of channels works...
+// ...(e.g. a 7.1.4 bus is three groups of four floats, or six groups of two doubles).
+template<typename SampleType>
+struct IIRChain
+{
+    using Register = SIMDRegister<SampleType>;
+    static constexpr size_t numLanes = numSIMDLanes<SampleType>;
+    
+    // Must be called off the audio thread, this allocates
+    void prepare(size_t numChannels, int maximumBlockSize)
+    {
+        // One chain per group of channels. Every chain gets the same coefficients, so all the...
+        // ...channels are always linked. (Chains that survive a resize keep their coefficients.)
+        filterChains.resize(juce::jmax((size_t)1, (numChannels + numLanes - 1) / numLanes));
+        for (auto& filterChain : filterChains)
+            filterChain.reset();
+        
+        // (big enough for 4x oversampled blocks, and reused by every group)
+        interleaver.prepare(maximumBlockSize * 4);
+        
+        // Transitions copy the chains into these, so they never allocate on the audio thread
+        outgoingChains.resize(filterChains.size());
+        transitionSamples.assign((size_t)maximumBlockSize * 4, Register::expand(0));
+        transitionSamplesRemaining = 0;
+        
+        // Polyphase IIR halfbands keep the oversampling latency low,...
+        // ...and integer latency lets us report it to the host exactly
+        for (size_t i = 0; i < oversamplers.size(); i++)
+        {
+            if (oversamplers[i] == nullptr || oversamplers[i]->numChannels != numChannels)
+            {
+                oversamplers[i] = std::make_unique<juce::dsp::Oversampling<SampleType>>(numChannels,
+                                                                                         i + 1,
+                                                                                         juce::dsp::Oversampling<SampleType>::filterHalfBandPolyphaseIIR,
+                                                                                         true,
+                                                                                         true);
+            }
+            
+            oversamplers[i]->initProcessing((size_t)maximumBlockSize);
+        }
+    }
+    
+    bool isPrepared() const { return oversamplers[0] != nullptr; }
+    
+    // Moves every group's chain towards a new design over numSteps control steps.
+    // If the design switches sections on or off, the old chain keeps running next to the new one...
+    // ...for crossfadeSamples (at the design's rate) and gets crossfaded out, so the sections...
+    // ...that start from silence (or stop dead) don't click. 0 switches over straight away.
+    void setTargetCoefficients(const ChainCoefficients& chainCoefficients, int numSteps, int crossfadeSamples)
+    {
+        if (crossfadeSamples > 0 && ! filterChains.empty()
+            && filterChains.front().wouldChangeActiveSections(chainCoefficients.settings))
+        {
+            // (Same size both sides, so this only copies.) If a transition was already running,...
+            // ...the new one starts from what the chains do now.
+            outgoingChains = filterChains;
+            transitionLength = crossfadeSamples;
+            transitionSamplesRemaining = crossfadeSamples;
+        }
+        
+        for (auto& filterChain : filterChains)
+            filterChain.setTargetCoefficients(chainCoefficients, numSteps);
+    }
+    
+    bool isInTransition() const { return transitionSamplesRemaining > 0; }
+    
+    // Clears the filter state, and that of the oversampler for oversamplingOrder
+    void reset(int oversamplingOrder)
+    {
+        for (auto& filterChain : filterChains)
+            filterChain.reset();
+        
+        // Nothing to crossfade from any more
+        transitionSamplesRemaining = 0;
+        
+        if (oversamplingOrder > 0 && isPrepared())
+            oversamplers[(size_t)oversamplingOrder - 1]->reset();
+    }
+    
+    float getLatencyInSamples(int oversamplingOrder) const
+    {
+        if (oversamplingOrder == 0 || ! isPrepared())
+            return 0.f;
+        
+        return (float)oversamplers[(size_t)oversamplingOrder - 1]->getLatencyInSamples();
+    }
+    
+    // Runs the chain over block, at whatever rate it was designed for
+    void process(juce::dsp::AudioBlock<SampleType>& block, int oversamplingOrder, size_t controlInterval) noexcept
+    {
+        jassert(isPrepared());
+        
+        if (oversamplingOrder == 0)
+        {
+            processAtBlockRate(block, controlInterval);
+            return;
+        }
+        
+        // Filter at the oversampled rate, where the bilinear transform barely warps the audible range
+        auto& oversampler = *oversamplers[(size_t)oversamplingOrder - 1];
+        auto oversampledBlock = oversampler.processSamplesUp(block);
+        processAtBlockRate(oversampledBlock, controlInterval);
+        oversampler.processSamplesDown(block);
+    }
+private:
+    void processAtBlockRate(juce::dsp::AudioBlock<SampleType>& block, size_t controlInterval) noexcept
+    {
+        const auto numChannels = block.getNumChannels();
+        const auto numSamples = block.getNumSamples();
+        jassert(numChannels <= filterChains.size() * numLanes);
+        
+        // Only transitions pay for the second chain, steady state takes the same path as always
+        if (isInTransition())
+        {
+            processTransition(block, controlInterval);
+            return;
+        }
+        
+        for (size_t group = 0; group < filterChains.size(); group++)
+        {
+            const auto firstChannel = group * numLanes;
+            if (firstChannel >= numChannels)
+                break;
+            
+            // interleave the group's channels so each one sits in its own SIMD lane,...
+            // ...filter all of them at once, then write them back to the block.
+            // (A partly filled group just filters whatever is left in its unused lanes.)
+            auto groupBlock = block.getSubsetChannelBlock(firstChannel, juce::jmin(numLanes, numChannels - firstChannel));
+            interleaver.interleave(groupBlock);
+            filterChains[group].process(interleaver.getData(), numSamples, controlInterval);
+            interleaver.deinterleave(groupBlock);
+        }
+    }
+    
+    // Same as above, but every group runs through its old chain as well, and the old chain's output...
+    // ...fades out linearly while the new one's fades in
+    void processTransition(juce::dsp::AudioBlock<SampleType>& block, size_t controlInterval) noexcept
+    {
+        const auto numChannels = block.getNumChannels();
+        const auto numSamples = block.getNumSamples();
+        jassert(numSamples <= transitionSamples.size());
+        
+        // Where this block starts in the crossfade
+        const auto fadePosition = transitionLength - transitionSamplesRemaining;
+        const auto fadeStep = (SampleType)1 / (SampleType)transitionLength;
+        const auto numFadeSamples = juce::jmin(numSamples, (size_t)transitionSamplesRemaining);
+        
+        for (size_t group = 0; group < filterChains.size(); group++)
+        {
+            const auto firstChannel = group * numLanes;
+            if (firstChannel >= numChannels)
+                break;
+            
+            auto groupBlock = block.getSubsetChannelBlock(firstChannel, juce::jmin(numLanes, numChannels - firstChannel));
+            interleaver.interleave(groupBlock);
+            
+            auto* samples = interleaver.getData();
+            auto* outgoingSamples = transitionSamples.data();
+            std::copy(samples, samples + numSamples, outgoingSamples);
+            
+            filterChains[group].process(samples, numSamples, controlInterval);
+            outgoingChains[group].process(outgoingSamples, numSamples, controlInterval);
+            
+            for (size_t n = 0; n < numFadeSamples; n++)
+            {
+                const auto gain = Register::expand((SampleType)(fadePosition + (int)n + 1) * fadeStep);
+                samples[n] = outgoingSamples[n] + gain * (samples[n] - outgoingSamples[n]);
+            }
+            
+            interleaver.deinterleave(groupBlock);
+        }
+        
+        transitionSamplesRemaining -= (int)numFadeSamples;
+    }
+    
+    std::vector<SIMDChain<SampleType>> filterChains;
+    SIMDChannelInterleaver<SampleType> interleaver;
+    
+    // Bypass and slope transitions: the chains as they were before the switch, where their output...
+    // ...goes while it's being faded out, and how far through the crossfade we are
+    std::vector<SIMDChain<SampleType>> outgoingChains;
+    std::vector<Register> transitionSamples;
+    int transitionLength {0}, transitionSamplesRemaining {0};
+    std::array<std::unique_ptr<juce::dsp::Oversampling<SampleType>>, 2> oversamplers;
+};
+
 //==============================================================================
 /**
 */
-class _3BandEQAudioProcessor  : public juce::AudioProcessor
+class _3BandEQAudioProcessor  : public juce::AudioProcessor,
+                                private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -282,6 +972,13 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    // 64-bit hosts can give us their buffers as they are, rather than converting them to float and back
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override { return true; }
+    
+    // Host bypass: passed straight through, but the filters start from silence once it's switched off again
+    void processBlockBypassed (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlockBypassed (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -303,6 +1000,8 @@ public:
     void changeProgramName (int index, const juce::String& newName) override;
 
     //==============================================================================
+    // State is saved as a small binary block (see writeBinaryState()).
+    // Older states, saved as the APVTS ValueTree, still load.
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
@@ -314,22 +1013,187 @@ public:
     SingleChannelSampleFifo<BlockType> leftChannelFIFO { Channel::LEFT };
     SingleChannelSampleFifo<BlockType> rightChannelFIFO { Channel::RIGHT };
     
+    // What the analyzer is currently set to look at (safe to call from any thread)
+    AnalyzerChannels getAnalyzerChannels() const;
+    
+    // Oversampling order for the IIR chain, from the realtime or the offline setting depending on...
+    // ...how we're being rendered. Always 0 in linear phase mode, which runs at the host rate.
+    int getOversamplingOrder(bool linearPhase) const;
+    
+    // One consistent set of the chain's current parameter values (safe to call from any thread)
+    ChainSettings getCurrentChainSettings() const { return chainSettingsSnapshot.read(); }
+    
+    // Audio thread statistics for this instance (safe to call from any thread)
+    ProcessingStats::Snapshot getProcessingStats() const;
+    void resetProcessingStats();
+    
 private:
-    // Declare two of these mono chains. One for left channel, one for right channel.
-    MonoChain leftChain, rightChain;
+    ProcessingStats processingStats;
+    
+    // One chain processes every channel, one channel per SIMD lane.
+    // Both precisions always get the same coefficients, but only the one the host uses gets prepared.
+    IIRChain<float> floatIIRChain;
+    IIRChain<double> doubleIIRChain;
+    
+    template<typename SampleType>
+    IIRChain<SampleType>& getIIRChain()
+    {
+        if constexpr (std::is_same_v<SampleType, double>)
+            return doubleIIRChain;
+        else
+            return floatIIRChain;
+    }
+    
+    // Helper function for both processBlock() overloads
+    template<typename SampleType>
+    void processSamples(juce::AudioBuffer<SampleType>& buffer);
+    
+    // Sleep mode: once the input has been silent for longer than the applied design's tail,...
+    // ...blocks are cleared rather than filtered. Silence means below -120 dB on every channel.
+    static constexpr double silenceThreshold = 1.0e-6;
+    juce::int64 numSilentInputSamples {0};
+    bool isSleeping {false};
+    // The applied design's tail, including latency: in samples for the audio thread, and in...
+    // ...seconds for getTailLengthSeconds(), which the host may call from any thread
+    juce::int64 tailLengthInSamples {0};
+    std::atomic<double> tailLengthSeconds {0};
+    // Helper function to keep track of the silence, returns true if this block can be skipped
+    template<typename SampleType>
+    bool shouldSleep(const juce::AudioBuffer<SampleType>& buffer, int numInputChannels);
+    
+    // Clears the state of everything that filters, without touching any coefficients
+    void resetProcessingState();
+    // Whether the previous block had the transport running, and whether the host bypassed it
+    bool wasTransportPlaying {false}, wasBypassedByHost {false};
+    // Set for the length of a realtime processBlock(), so we know not to call into the host
+    bool isInsideRealtimeBlock {false};
     
-    void updatePeakFilter(const ChainSettings& ChainSettings);
+    // Latency of the applied design. From a realtime block the host hears about it on the message...
+    // ...thread (handleAsyncUpdate()), everywhere else straight away.
+    std::atomic<int> latencyInSamples {0};
+    void reportLatency(int latency);
+    void handleAsyncUpdate() override;
+    // Helper function to reset everything when the transport stops or the host bypass comes off,...
+    // ...so nothing left over (decaying or not) carries into what plays next
+    void resetOnTransportOrBypassChange();
     
-    // Helper functions to update low- and high- cut filters
-    void updateLowCutFilter(const ChainSettings& chainSettings);
-    void updateHighCutFilter(const ChainSettings& chainSettings);
+    // The host compensates for our latency whether we're bypassed or not, so the bypassed...
+    // ...signal has to come out just as late as the processed one. It goes through these,...
+    // ...which prepareToPlay() sizes for the longest latency we can report, so bypass never allocates.
+    juce::dsp::DelayLine<float, juce::dsp::DelayLineInterpolationTypes::None> floatBypassDelay;
+    juce::dsp::DelayLine<double, juce::dsp::DelayLineInterpolationTypes::None> doubleBypassDelay;
+    int maxBypassDelayInSamples {0};
     
+    template<typename SampleType>
+    auto& getBypassDelay()
+    {
+        if constexpr (std::is_same_v<SampleType, double>)
+            return doubleBypassDelay;
+        else
+            return floatBypassDelay;
+    }
+    
+    // Helper function for both processBlockBypassed() overloads
+    template<typename SampleType>
+    void processBypassed(juce::AudioBuffer<SampleType>& buffer);
+    
+    // Automation resolution: Per Block, or a fixed sub-block size of 16, 32, 64 or 128 samples
+    std::atomic<float>* automationResolution {APVTS.getRawParameterValue("Automation_Resolution")};
+    // Number of samples per sub-block, or 0 to update the filters once per block
+    size_t getAutomationSubBlockSize() const;
+    // Helper function to run the IIR chain over a block in sub-blocks, moving the settings from the...
+    // ...last block's towards the current ones at each sub-block. Returns false if it can't...
+    // ...(e.g. something other than a frequency, gain or Q changed), and the block is left untouched.
+    template<typename SampleType>
+    bool processInSubBlocks(juce::dsp::AudioBlock<SampleType>& block);
+    
+    // Packed, tear-free copy of the chain's parameters (must be declared after APVTS)
+    ChainSettingsSnapshot chainSettingsSnapshot {APVTS};
+    
+    // Binary state: a header ("3BEQ", version, number of parameters), then the ID hash and...
+    // ...(denormalised) value of every parameter, all little endian. Parameters are matched up...
+    // ...by their ID hash (FNV-1a, see getStateParameterHash()), so states from versions with...
+    // ...more or fewer parameters load too. Tools/StateTests checks this against a saved fixture.
+    static constexpr juce::uint32 binaryStateMagic = 0x51454233; // "3BEQ"
+    static constexpr juce::uint32 binaryStateVersion = 1;
+    void writeBinaryState(juce::OutputStream& stream) const;
+    // notBinary: it doesn't start with "3BEQ", so it may be an older ValueTree state.
+    // unsupported: it's a binary state, but from a newer version (or cut short), so it's ignored.
+    // Nothing is changed unless it returns loaded.
+    enum class BinaryStateResult { loaded, notBinary, unsupported };
+    BinaryStateResult readBinaryState(const void* data, int sizeInBytes);
+    
+    // Linear phase mode: the whole chain as one long FIR filter.
+    // The non-uniform partitioning keeps it at zero latency of its own, so the only delay is the kernel's.
+    MultichannelConvolution linearPhaseConvolution;
+    // Whether the applied design runs through the convolution instead of the IIR chain
+    bool isLinearPhaseActive {false};
+    // juce::dsp::Convolution only works in float, so double precision blocks go through this first
+    juce::AudioBuffer<float> convolutionBuffer;
+    // Helper function to run the convolution over a block of either precision
+    template<typename SampleType>
+    void processLinearPhase(juce::dsp::AudioBlock<SampleType>& block);
+    
+    // (must be declared after linearPhaseConvolution)
+    FilterDesignThread filterDesignThread {linearPhaseConvolution};
+    
+    // Oversampling for the IIR chain: Off, 2x or 4x, set separately for realtime and offline rendering
+    std::atomic<float>* oversampling {APVTS.getRawParameterValue("Oversampling")};
+    std::atomic<float>* offlineOversampling {APVTS.getRawParameterValue("Oversampling_Offline")};
+    // The oversampling order the applied design was made for
+    int appliedOversamplingOrder {0};
     
-    // Helper function to update all filters in the chain
+    // The settings we last asked for, the ones the chains are actually running (the design thread...
+    // ...may not have caught up yet), and the id of the design currently in the chains
+    ChainSettings lastRequestedSettings, appliedSettings;
+    int lastRequestedDesignId {0}, appliedDesignId {0};
+    
+    // Coefficient smoothing: Off, or a control interval of 16, 32 or 64 samples
+    std::atomic<float>* coefficientSmoothing {APVTS.getRawParameterValue("Coefficient_Smoothing")};
+    // How long the coefficients take to glide to a new design
+    static constexpr double smoothingTimeSeconds = 0.02;
+    // How long bypass and slope changes take to crossfade over (see IIRChain::setTargetCoefficients())
+    static constexpr double transitionTimeSeconds = 0.005;
+    // Number of samples between coefficient steps, or 0 when smoothing is off
+    size_t getSmoothingControlInterval() const;
+    
+    // Analyzer channel mode, see AnalyzerChannels
+    std::atomic<float>* analyzerChannels {APVTS.getRawParameterValue("Analyzer_Channels")};
+    // Helper function to feed the analyzer FIFOs whatever the analyzer channel mode asks for
+    template<typename SampleType>
+    void updateAnalyzerFIFOs(const juce::AudioBuffer<SampleType>& buffer);
+    
+    // Helper function to apply a full set of designed coefficients to the chain,...
+    // ...either straight away or by gliding towards them
+    void applyChainCoefficients(const ChainCoefficients& chainCoefficients, bool shouldSmooth);
+    // The parts of that: handing the coefficients to both chains,...
+    void setChainCoefficients(const ChainCoefficients& chainCoefficients, int numSteps, int crossfadeSamples);
+    // ...and, once the chains are set up for a design, updating the latency, tail and statistics for it
+    void finishApplyingDesign(const ChainCoefficients& chainCoefficients);
+    
+    // Helper function to update all filters in the chain.
+    // Only requests a new design when a parameter has actually changed.
     void updateFilters();
+    // Designs and applies the current settings immediately, on the calling thread
+    void updateFiltersImmediately(bool shouldSmooth);
+    // Same as above, for any settings. Only allocates if they're in linear phase mode.
+    void applySettingsImmediately(const ChainSettings& settings, bool shouldSmooth);
     
-    // TEST OSCILLATOR
-    juce::dsp::Oscillator<float> osc;
+    // What prepareToPlay() last prepared everything for
+    struct PreparedSpec
+    {
+        double sampleRate {0};
+        int maximumBlockSize {0};
+        int numChannels {0};
+        bool doublePrecision {false};
+        
+        bool operator==(const PreparedSpec& other) const
+        {
+            return sampleRate == other.sampleRate && maximumBlockSize == other.maximumBlockSize
+                && numChannels == other.numChannels && doublePrecision == other.doublePrecision;
+        }
+    };
+    PreparedSpec preparedSpec;
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (_3BandEQAudioProcessor)
 };
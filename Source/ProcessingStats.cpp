@@ -0,0 +1,247 @@
+/*
+  ==============================================================================
+
+    Lock-free audio thread statistics: block timing, overruns, dropped work...
+    ...and (when EQ_DETECT_AUDIO_THREAD_ALLOCATIONS is on) heap allocations made while processing.
+
+  ==============================================================================
+*/
+
+#include "ProcessingStats.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+#if EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+namespace
+{
+    // The stats of whichever instance is processing a block on this thread right now, if any
+    thread_local ProcessingStats* statsForThisThread = nullptr;
+    
+    // Every heap allocation in the binary comes through here, so this has to stay tiny.
+    // (No jassert in here: that logs, and logging allocates.)
+    void* allocate(std::size_t size) noexcept
+    {
+        if (auto* stats = statsForThisThread)
+            stats->countAllocation();
+        
+        return std::malloc(size > 0 ? size : 1);
+    }
+    
+    // Over-aligned types (SIMD registers and the like) come through here instead...
+    // ...and have to be freed with the matching function, which on Windows isn't free()
+    void* allocateAligned(std::size_t size, std::align_val_t alignment) noexcept
+    {
+        if (auto* stats = statsForThisThread)
+            stats->countAllocation();
+        
+        size = size > 0 ? size : 1;
+       #if JUCE_WINDOWS
+        return _aligned_malloc(size, (std::size_t)alignment);
+       #else
+        void* memory = nullptr;
+        if (posix_memalign(&memory, juce::jmax((std::size_t)alignment, sizeof(void*)), size) != 0)
+            return nullptr;
+        return memory;
+       #endif
+    }
+    
+    void freeAligned(void* memory) noexcept
+    {
+       #if JUCE_WINDOWS
+        _aligned_free(memory);
+       #else
+        std::free(memory);
+       #endif
+    }
+}
+
+// All of the replaceable forms, so nothing allocated one way is freed another
+void* operator new(std::size_t size)
+{
+    if (auto* memory = allocate(size))
+        return memory;
+    
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (auto* memory = allocateAligned(size, alignment))
+        return memory;
+    
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)                                                          { return operator new(size); }
+void* operator new[](std::size_t size, std::align_val_t alignment)                              { return operator new(size, alignment); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept                            { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept                          { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept    { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept  { return allocateAligned(size, alignment); }
+
+void operator delete(void* memory) noexcept                                                     { std::free(memory); }
+void operator delete[](void* memory) noexcept                                                   { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept                                        { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept                                      { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept                              { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept                            { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept                                   { freeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept                                 { freeAligned(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept                      { freeAligned(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept                    { freeAligned(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept            { freeAligned(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept          { freeAligned(memory); }
+#endif
+
+//==============================================================================
+
+ProcessingStats::ScopedBlockTimer::ScopedBlockTimer(ProcessingStats& s, int n, double sr, bool isRealtime) noexcept :
+stats(s),
+numSamples(n),
+sampleRate(sr),
+startTicks(juce::Time::getHighResolutionTicks())
+#if EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+, previousStats(statsForThisThread),
+allocationsBefore(s.numAudioThreadAllocations.load(std::memory_order_relaxed))
+#endif
+{
+   #if EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+    statsForThisThread = isRealtime ? &stats : nullptr;
+   #else
+    juce::ignoreUnused(isRealtime);
+   #endif
+}
+
+ProcessingStats::ScopedBlockTimer::~ScopedBlockTimer() noexcept
+{
+   #if EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+    statsForThisThread = previousStats;
+    
+    // Something in processBlock() allocated. Step through it again to find out what.
+    jassert(stats.numAudioThreadAllocations.load(std::memory_order_relaxed) == allocationsBefore);
+   #endif
+    
+    auto elapsedTicks = juce::Time::getHighResolutionTicks() - startTicks;
+    stats.addBlock(juce::Time::highResolutionTicksToSeconds(elapsedTicks), numSamples, sampleRate);
+}
+
+//==============================================================================
+
+void ProcessingStats::addBlock(double elapsedSeconds, int numSamples, double sampleRate) noexcept
+{
+    const auto microseconds = elapsedSeconds * 1.0e6;
+    
+    auto bucket = (int)(std::log2(juce::jmax(microseconds, minimumMicroseconds) / minimumMicroseconds) * bucketsPerOctave);
+    blockTimeHistogram[(size_t)juce::jlimit(0, numBuckets - 1, bucket)].fetch_add(1, std::memory_order_relaxed);
+    numBlocks.fetch_add(1, std::memory_order_relaxed);
+    
+    if (microseconds > worstMicroseconds.load(std::memory_order_relaxed))
+        worstMicroseconds.store(microseconds, std::memory_order_relaxed);
+    
+    // The deadline is however long the block lasts in real time
+    if (numSamples > 0 && sampleRate > 0)
+    {
+        const auto load = elapsedSeconds * sampleRate / numSamples;
+        
+        if (load > 1.0)
+            numOverruns.fetch_add(1, std::memory_order_relaxed);
+        if (load > worstLoad.load(std::memory_order_relaxed))
+            worstLoad.store(load, std::memory_order_relaxed);
+    }
+}
+
+ProcessingStats::Snapshot ProcessingStats::getSnapshot() const
+{
+    Snapshot snapshot;
+    snapshot.numBlocks = numBlocks.load(std::memory_order_relaxed);
+    snapshot.numOverruns = numOverruns.load(std::memory_order_relaxed);
+    snapshot.worstMicroseconds = worstMicroseconds.load(std::memory_order_relaxed);
+    snapshot.worstLoad = worstLoad.load(std::memory_order_relaxed);
+    snapshot.numDesignsApplied = numDesignsApplied.load(std::memory_order_relaxed);
+    snapshot.numDesignRequestsDropped = numDesignRequestsDropped.load(std::memory_order_relaxed);
+    snapshot.numAudioThreadAllocations = numAudioThreadAllocations.load(std::memory_order_relaxed);
+    
+    // Percentiles from the histogram, taking the (geometric) middle of the bucket they land in
+    std::array<juce::uint32, numBuckets> counts;
+    juce::int64 total = 0;
+    for (size_t i = 0; i < counts.size(); i++)
+        total += counts[i] = blockTimeHistogram[i].load(std::memory_order_relaxed);
+    
+    auto getPercentile = [&counts, total](double fraction)
+    {
+        if (total == 0)
+            return 0.0;
+        
+        auto target = (juce::int64)std::ceil(fraction * (double)total);
+        juce::int64 count = 0;
+        
+        for (size_t i = 0; i < counts.size(); i++)
+        {
+            count += counts[i];
+            if (count >= target)
+                return minimumMicroseconds * std::exp2(((double)i + 0.5) / bucketsPerOctave);
+        }
+        
+        return minimumMicroseconds * std::exp2((double)numBuckets / bucketsPerOctave);
+    };
+    
+    // (None of them can be worse than the worst block)
+    snapshot.medianMicroseconds = juce::jmin(getPercentile(0.5), snapshot.worstMicroseconds);
+    snapshot.p90Microseconds = juce::jmin(getPercentile(0.9), snapshot.worstMicroseconds);
+    snapshot.p99Microseconds = juce::jmin(getPercentile(0.99), snapshot.worstMicroseconds);
+    
+    return snapshot;
+}
+
+void ProcessingStats::reset() noexcept
+{
+    for (auto& count : blockTimeHistogram)
+        count.store(0, std::memory_order_relaxed);
+    
+    numBlocks.store(0, std::memory_order_relaxed);
+    numOverruns.store(0, std::memory_order_relaxed);
+    numDesignsApplied.store(0, std::memory_order_relaxed);
+    numDesignRequestsDropped.store(0, std::memory_order_relaxed);
+    numAudioThreadAllocations.store(0, std::memory_order_relaxed);
+    worstMicroseconds.store(0, std::memory_order_relaxed);
+    worstLoad.store(0, std::memory_order_relaxed);
+}
+
+//==============================================================================
+
+juce::var ProcessingStats::Snapshot::toVar() const
+{
+    juce::DynamicObject::Ptr object = new juce::DynamicObject();
+    object->setProperty("blocks", numBlocks);
+    object->setProperty("overruns", numOverruns);
+    object->setProperty("median_us", medianMicroseconds);
+    object->setProperty("p90_us", p90Microseconds);
+    object->setProperty("p99_us", p99Microseconds);
+    object->setProperty("worst_us", worstMicroseconds);
+    object->setProperty("worst_load", worstLoad);
+    object->setProperty("designs_applied", numDesignsApplied);
+    object->setProperty("design_requests_dropped", numDesignRequestsDropped);
+    object->setProperty("analyzer_samples_dropped", numAnalyzerSamplesDropped);
+    object->setProperty("audio_thread_allocations", numAudioThreadAllocations);
+    return juce::var(object.get());
+}
+
+juce::String ProcessingStats::Snapshot::toString() const
+{
+    auto text = "p50 " + juce::String(medianMicroseconds, 1) + " us"
+              + "  p99 " + juce::String(p99Microseconds, 1) + " us"
+              + "  worst " + juce::String(juce::roundToInt(worstLoad * 100.0)) + "%"
+              + "  overruns " + juce::String(numOverruns)
+              + "  designs " + juce::String(numDesignsApplied);
+    
+    if (numDesignRequestsDropped > 0)
+        text << "  dropped requests " << numDesignRequestsDropped;
+    if (numAnalyzerSamplesDropped > 0)
+        text << "  dropped analyzer samples " << numAnalyzerSamplesDropped;
+    if (numAudioThreadAllocations > 0)
+        text << "  allocations " << numAudioThreadAllocations;
+    
+    return text;
+}
@@ -0,0 +1,101 @@
+/*
+  ==============================================================================
+
+    Lock-free audio thread statistics: block timing, overruns, dropped work...
+    ...and (when EQ_DETECT_AUDIO_THREAD_ALLOCATIONS is on) heap allocations made while processing.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+#include <array>
+#include <atomic>
+
+// Counts heap allocations made from inside processBlock(), and asserts on them.
+// This replaces the global operator new and delete, which in a plugin can mean replacing them...
+// ...for the whole host (on Linux the plugin's definitions can interpose on everyone else's)...
+// ...so it's off unless asked for. Turn it on in the Benchmark or BatchRender tools, or in a...
+// ...Standalone build, with EQ_DETECT_AUDIO_THREAD_ALLOCATIONS=1 in the project's defines.
+#ifndef EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+ #define EQ_DETECT_AUDIO_THREAD_ALLOCATIONS 0
+#endif
+
+// Per-instance processing statistics.
+// The audio thread only ever does a handful of relaxed atomic increments per block.
+// Everything else (percentiles etc.) is worked out by whoever asks for a Snapshot.
+struct ProcessingStats
+{
+    // The statistics at one moment, for the editor or the command line tools
+    struct Snapshot
+    {
+        juce::int64 numBlocks {0};
+        // Blocks that took longer to process than they last in real time
+        juce::int64 numOverruns {0};
+        // Block processing times in microseconds (percentiles are accurate to a quarter octave)
+        double medianMicroseconds {0}, p90Microseconds {0}, p99Microseconds {0}, worstMicroseconds {0};
+        // The worst processing time as a fraction of its block's duration (1 = the whole deadline)
+        double worstLoad {0};
+        
+        // Filter designs applied, and design requests dropped because the queue was full
+        juce::int64 numDesignsApplied {0}, numDesignRequestsDropped {0};
+        // Samples the analyzer never saw, because the GUI fell behind and its FIFO was full
+        juce::int64 numAnalyzerSamplesDropped {0};
+        // Heap allocations made while processing (always 0 unless EQ_DETECT_AUDIO_THREAD_ALLOCATIONS)
+        juce::int64 numAudioThreadAllocations {0};
+        
+        // For JSON
+        juce::var toVar() const;
+        // One line summary, for the editor
+        juce::String toString() const;
+    };
+    
+    // Times one block from construction to destruction, and counts the heap allocations...
+    // ...made on this thread in between. Offline rendering is allowed to allocate (it designs...
+    // ...filters on the audio thread), so allocations are only counted in real time.
+    // That includes whatever the host allocates when we call into it (e.g. for the play head):...
+    // ...it's still our block that's late.
+    struct ScopedBlockTimer
+    {
+        ScopedBlockTimer(ProcessingStats& stats, int numSamples, double sampleRate, bool isRealtime) noexcept;
+        ~ScopedBlockTimer() noexcept;
+    private:
+        ProcessingStats& stats;
+        const int numSamples;
+        const double sampleRate;
+        const juce::int64 startTicks;
+       #if EQ_DETECT_AUDIO_THREAD_ALLOCATIONS
+        ProcessingStats* const previousStats;
+        const juce::int64 allocationsBefore;
+       #endif
+        
+        JUCE_DECLARE_NON_COPYABLE (ScopedBlockTimer)
+    };
+    
+    // Called from the audio thread
+    void countDesignApplied() noexcept { numDesignsApplied.fetch_add(1, std::memory_order_relaxed); }
+    void countDesignRequestDropped() noexcept { numDesignRequestsDropped.fetch_add(1, std::memory_order_relaxed); }
+    void countAllocation() noexcept { numAudioThreadAllocations.fetch_add(1, std::memory_order_relaxed); }
+    
+    // Can be called from any thread. The counters are read one at a time, so a snapshot taken...
+    // ...while the audio thread is running may be a block out between them.
+    Snapshot getSnapshot() const;
+    // Starts counting again from zero. Only exact while the audio thread is not running.
+    void reset() noexcept;
+private:
+    void addBlock(double elapsedSeconds, int numSamples, double sampleRate) noexcept;
+    
+    // Block times, in log spaced buckets of a quarter octave from 0.1 us up to about 1.7 s
+    static constexpr int bucketsPerOctave = 4;
+    static constexpr int numBuckets = 24 * bucketsPerOctave;
+    static constexpr double minimumMicroseconds = 0.1;
+    std::array<std::atomic<juce::uint32>, numBuckets> blockTimeHistogram {};
+    
+    std::atomic<juce::int64> numBlocks {0}, numOverruns {0};
+    std::atomic<juce::int64> numDesignsApplied {0}, numDesignRequestsDropped {0};
+    std::atomic<juce::int64> numAudioThreadAllocations {0};
+    // Only the audio thread writes these, so a plain load and store keeps the maximum
+    std::atomic<double> worstMicroseconds {0}, worstLoad {0};
+};
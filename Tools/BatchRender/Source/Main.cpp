@@ -0,0 +1,342 @@
+/*
+  ==============================================================================
+
+    Headless batch renderer: runs audio files through the EQ without a host.
+
+    Usage:
+      3BandEQBatchRender (--preset <file> | --settings <file>) --output <dir>
+                         [--threads <n>] [--block-size <n>] [--stats] <input files...>
+
+    --preset takes a state blob, as saved by getStateInformation().
+    --settings takes a JSON object of parameter IDs and values, e.g.
+      { "LowCut_Freq": 80, "Peak_Gain": -3.5, "Phase_Mode": "Linear Phase" }
+    (choice parameters take either the choice name or its index).
+    --stats prints each worker's processing statistics as JSON at the end.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "../../../Source/PluginProcessor.h"
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+// Where the settings for every render come from
+struct RenderSettings
+{
+    juce::MemoryBlock presetState;
+    juce::var parameterValues;
+    int blockSize {8192};
+};
+
+struct RenderJob
+{
+    juce::File input, output;
+};
+
+// Every worker pulls the next file off this until there are none left,...
+// ...so a few long files don't hold up everything queued behind them
+struct RenderQueue
+{
+    std::vector<RenderJob> jobs;
+    std::atomic<size_t> nextJob {0};
+    std::atomic<int> numFinished {0}, numFailed {0};
+
+    const RenderJob* getNextJob()
+    {
+        auto index = nextJob++;
+        return index < jobs.size() ? &jobs[index] : nullptr;
+    }
+};
+
+juce::CriticalSection outputLock;
+
+void printLine(const juce::String& line, bool isError = false)
+{
+    const juce::ScopedLock sl(outputLock);
+    (isError ? std::cerr : std::cout) << line << std::endl;
+}
+
+// Helper function to set each parameter named in a JSON object
+bool applyParameterValues(_3BandEQAudioProcessor& processor, const juce::var& parameterValues)
+{
+    auto* object = parameterValues.getDynamicObject();
+    if (object == nullptr)
+        return false;
+
+    for (const auto& property : object->getProperties())
+    {
+        auto* parameter = processor.APVTS.getParameter(property.name.toString());
+        if (parameter == nullptr)
+        {
+            printLine("Unknown parameter: " + property.name.toString(), true);
+            return false;
+        }
+
+        // Choices can be given by name, everything else in its own units
+        if (property.value.isString())
+            parameter->setValueNotifyingHost(parameter->getValueForText(property.value.toString()));
+        else
+            parameter->setValueNotifyingHost(parameter->convertTo0to1((float)property.value));
+    }
+
+    return true;
+}
+
+// Each worker owns one processor for its whole life, and reuses it for every file it renders
+class RenderWorker : public juce::Thread
+{
+public:
+    RenderWorker(RenderQueue& q, const RenderSettings& s, int index) :
+    juce::Thread("3BandEQ Render " + juce::String(index)),
+    queue(q),
+    settings(s)
+    {
+        formatManager.registerBasicFormats();
+
+        processor.setNonRealtime(true);
+
+        if (settings.presetState.getSize() > 0)
+            processor.setStateInformation(settings.presetState.getData(), (int)settings.presetState.getSize());
+
+        if (! settings.parameterValues.isVoid())
+            applyParameterValues(processor, settings.parameterValues);
+    }
+
+    ~RenderWorker() override { stopThread(10000); }
+
+    ProcessingStats::Snapshot getProcessingStats() const { return processor.getProcessingStats(); }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            auto* job = queue.getNextJob();
+            if (job == nullptr)
+                return;
+
+            auto error = renderFile(*job);
+            if (error.isEmpty())
+            {
+                printLine("Rendered " + job->output.getFullPathName());
+            }
+            else
+            {
+                queue.numFailed++;
+                printLine(job->input.getFullPathName() + ": " + error, true);
+            }
+
+            queue.numFinished++;
+        }
+    }
+private:
+    // Returns an error message, or an empty string if the file was rendered
+    juce::String renderFile(const RenderJob& job)
+    {
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(job.input));
+        if (reader == nullptr)
+            return "can't read this file";
+
+        auto* format = formatManager.findFormatForFileExtension(job.output.getFileExtension());
+        if (format == nullptr)
+            return "no format to write " + job.output.getFileExtension() + " files with";
+
+        const auto numChannels = (int)reader->numChannels;
+        const auto sampleRate = reader->sampleRate;
+        const auto blockSize = settings.blockSize;
+
+        // Keep the bit depth where the output format allows it
+        auto bitsPerSample = (int)reader->bitsPerSample;
+        if (! format->getPossibleBitDepths().contains(bitsPerSample))
+            bitsPerSample = 24;
+
+        job.output.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream(job.output.createOutputStream());
+        if (stream == nullptr)
+            return "can't create " + job.output.getFullPathName();
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(),
+                                                                                sampleRate,
+                                                                                (unsigned int)numChannels,
+                                                                                bitsPerSample,
+                                                                                reader->metadataValues,
+                                                                                0));
+        if (writer == nullptr)
+            return "can't write " + juce::String(numChannels) + " channels at " + juce::String(sampleRate) + " Hz";
+
+        // The writer owns the stream now
+        stream.release();
+
+        // Set the processor up exactly like a host would for this file
+        processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+        if (processor.getTotalNumOutputChannels() != numChannels)
+            return "the EQ doesn't support " + juce::String(numChannels) + " channels";
+
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        // Linear phase and oversampling delay the output, so render that much past the end of the...
+        // ...file (the reader fills in silence there) and drop the same amount from the start.
+        // (prepareToPlay() has already put the linear phase kernel in place, so this is exact...
+        // ...from the very first sample, and the same however busy the machine is.)
+        const auto latency = (juce::int64)processor.getLatencySamples();
+        const auto numSamplesToRender = reader->lengthInSamples + latency;
+        auto numSamplesToSkip = latency;
+
+        // Whole blocks are read, processed and written in place, with no per-sample copying
+        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+        juce::MidiBuffer midiMessages;
+
+        for (juce::int64 position = 0; position < numSamplesToRender; position += blockSize)
+        {
+            if (threadShouldExit())
+                return "cancelled";
+
+            const auto numSamples = (int)juce::jmin((juce::int64)blockSize, numSamplesToRender - position);
+            buffer.setSize(numChannels, numSamples, false, false, true);
+
+            reader->read(&buffer, 0, numSamples, position, true, true);
+            processor.processBlock(buffer, midiMessages);
+
+            const auto skip = (int)juce::jmin(numSamplesToSkip, (juce::int64)numSamples);
+            numSamplesToSkip -= skip;
+
+            if (skip < numSamples && ! writer->writeFromAudioSampleBuffer(buffer, skip, numSamples - skip))
+                return "can't write to " + job.output.getFullPathName();
+        }
+
+        processor.releaseResources();
+        return {};
+    }
+
+    RenderQueue& queue;
+    const RenderSettings& settings;
+
+    juce::AudioFormatManager formatManager;
+    _3BandEQAudioProcessor processor;
+};
+
+void printUsage()
+{
+    printLine("Usage: 3BandEQBatchRender (--preset <file> | --settings <file>) --output <dir>\n"
+              "                          [--threads <n>] [--block-size <n>] [--stats] <input files...>");
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // The processor's parameters need a message manager, even if nothing ever runs its loop
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList arguments(argc, argv);
+    RenderSettings settings;
+
+    if (arguments.containsOption("--preset"))
+    {
+        auto presetFile = arguments.getFileForOption("--preset");
+        if (! presetFile.loadFileAsData(settings.presetState))
+        {
+            printLine("Can't read " + presetFile.getFullPathName(), true);
+            return 1;
+        }
+    }
+
+    if (arguments.containsOption("--settings"))
+    {
+        auto settingsFile = arguments.getFileForOption("--settings");
+        auto result = juce::JSON::parse(settingsFile.loadFileAsString(), settings.parameterValues);
+        if (result.failed() || ! settings.parameterValues.isObject())
+        {
+            printLine(settingsFile.getFullPathName() + " isn't a JSON object of parameter values", true);
+            return 1;
+        }
+    }
+
+    if (! arguments.containsOption("--output") || (settings.presetState.getSize() == 0 && settings.parameterValues.isVoid()))
+    {
+        printUsage();
+        return 1;
+    }
+
+    auto outputDirectory = arguments.getFileForOption("--output");
+    if (! outputDirectory.createDirectory())
+    {
+        printLine("Can't create " + outputDirectory.getFullPathName(), true);
+        return 1;
+    }
+
+    if (arguments.containsOption("--block-size"))
+        settings.blockSize = juce::jlimit(32, 1 << 16, arguments.getValueForOption("--block-size").getIntValue());
+
+    auto numThreads = juce::SystemStats::getNumCpus();
+    if (arguments.containsOption("--threads"))
+        numThreads = juce::jmax(1, arguments.getValueForOption("--threads").getIntValue());
+
+    // Everything that isn't an option (or an option's value) is an input file
+    const juce::StringArray optionsWithValues { "--preset", "--settings", "--output", "--threads", "--block-size" };
+    RenderQueue queue;
+    for (int i = 0; i < arguments.size(); i++)
+    {
+        const auto& argument = arguments[i];
+        if (argument.isOption())
+        {
+            if (optionsWithValues.contains(argument.text))
+                i++;
+
+            continue;
+        }
+
+        auto input = argument.resolveAsFile();
+        auto output = outputDirectory.getChildFile(input.getFileName());
+        if (output == input)
+        {
+            printLine("Not overwriting " + input.getFullPathName() + ", pick another output directory", true);
+            return 1;
+        }
+
+        queue.jobs.push_back({ input, output });
+    }
+
+    if (queue.jobs.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    // No point starting more workers than there are files
+    numThreads = juce::jmin(numThreads, (int)queue.jobs.size());
+
+    // The workers (and their processors) are created here, on the main thread, and then left to it
+    std::vector<std::unique_ptr<RenderWorker>> workers;
+    for (int i = 0; i < numThreads; i++)
+        workers.push_back(std::make_unique<RenderWorker>(queue, settings, i));
+
+    const auto startTime = juce::Time::getMillisecondCounterHiRes();
+
+    for (auto& worker : workers)
+        worker->startThread();
+    for (auto& worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    const auto seconds = (juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+    printLine(juce::String(queue.numFinished.load() - queue.numFailed.load()) + " of " + juce::String((int)queue.jobs.size())
+              + " files rendered in " + juce::String(seconds, 2) + " s on " + juce::String(numThreads) + " threads");
+
+    if (arguments.containsOption("--stats"))
+    {
+        juce::Array<juce::var> stats;
+        for (auto& worker : workers)
+            stats.add(worker->getProcessingStats().toVar());
+
+        printLine(juce::JSON::toString(juce::var(stats)));
+    }
+
+    return queue.numFailed.load() > 0 ? 1 : 0;
+}
@@ -0,0 +1,437 @@
+/*
+  ==============================================================================
+
+    Benchmarks for the EQ's processing, filter design and analyzer code.
+
+    Usage:
+      3BandEQBenchmark [--output <file>] [--min-time <ms>] [--filter <name>]
+
+    --filter only runs the groups whose names contain it:
+      processBlock, filterChain (SIMD against scalar), filterDesign, analyzer
+
+    Results are written as JSON (to stdout, unless --output is given), so they...
+    ...can be kept and compared across builds. Progress goes to stderr.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/PluginEditor.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const juce::StringArray slopeNames { "12 dB/oct", "24 dB/oct", "36 dB/oct", "48 dB/oct" };
+
+// Everything the benchmarks produce ends up in here
+struct BenchmarkResults
+{
+    juce::Array<juce::var> results;
+
+    void add(juce::DynamicObject::Ptr result)
+    {
+        std::cerr << juce::JSON::toString(juce::var(result.get()), true) << std::endl;
+        results.add(juce::var(result.get()));
+    }
+};
+
+// Results have to go somewhere the optimizer can't see through
+volatile double benchmarkSink = 0;
+
+// Calls function() in ever bigger batches until at least minTimeMs has passed,...
+// ...and returns the average time per call in nanoseconds
+template<typename Function>
+double measureNanosecondsPerCall(Function&& function, double minTimeMs)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Warm up the caches and branch predictors first
+    for (int i = 0; i < 3; i++)
+        function();
+
+    juce::int64 numCalls = 0;
+    juce::int64 batchSize = 1;
+    const auto start = Clock::now();
+    std::chrono::duration<double, std::nano> elapsed {0};
+
+    do
+    {
+        for (juce::int64 i = 0; i < batchSize; i++)
+            function();
+
+        numCalls += batchSize;
+        batchSize = juce::jmin(batchSize * 2, (juce::int64)1 << 16);
+        elapsed = Clock::now() - start;
+    }
+    while (elapsed.count() < minTimeMs * 1.0e6);
+
+    return elapsed.count() / (double)numCalls;
+}
+
+// Like measureNanosecondsPerCall(), for functions that process buffer in place.
+// Filtering the same buffer over and over feeds every call the last one's output: a +6 dB...
+// ...peak doubles its band each time, and within a few hundred calls it's all inf and NaN.
+// So buffer gets a fresh copy of source before every call, and the time that copy takes on...
+// ...its own is measured separately and taken back off.
+template<typename Function>
+double measureNanosecondsPerCallInPlace(Function&& function, juce::AudioBuffer<float>& buffer,
+                                        const juce::AudioBuffer<float>& source, double minTimeMs)
+{
+    auto restoreBuffer = [&]
+    {
+        for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+            buffer.copyFrom(channel, 0, source, channel, 0, buffer.getNumSamples());
+    };
+
+    auto restoreAndCallNanoseconds = measureNanosecondsPerCall([&] { restoreBuffer(); function(); }, minTimeMs);
+    auto restoreNanoseconds = measureNanosecondsPerCall(restoreBuffer, minTimeMs);
+
+    return juce::jmax(0.0, restoreAndCallNanoseconds - restoreNanoseconds);
+}
+
+// Quiet white noise, loud enough that the filters never run into denormals...
+// ...as long as it's restored before every call (see measureNanosecondsPerCallInPlace())
+void fillWithNoise(juce::AudioBuffer<float>& buffer)
+{
+    juce::Random random(1234);
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+        for (int n = 0; n < buffer.getNumSamples(); n++)
+            buffer.setSample(channel, n, 0.1f * (random.nextFloat() * 2.f - 1.f));
+}
+
+void setParameter(_3BandEQAudioProcessor& processor, const juce::String& parameterID, float value)
+{
+    auto* parameter = processor.APVTS.getParameter(parameterID);
+    jassert(parameter != nullptr);
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+}
+
+ChainSettings makeBenchmarkSettings(Slope slope)
+{
+    ChainSettings settings;
+    settings.lowCutFreq = 80.f;
+    settings.highCutFreq = 12000.f;
+    settings.lowCutSlope = slope;
+    settings.highCutSlope = slope;
+    settings.bands[0].freq = 1000.f;
+    settings.bands[0].gain_dB = 6.f;
+    settings.bands[0].Q = 1.f;
+
+    // Like the plugin's defaults, only the first parametric band is on
+    for (size_t band = 1; band < settings.bands.size(); band++)
+        settings.bands[band].bypass = true;
+
+    return settings;
+}
+
+//==============================================================================
+// The whole plugin, as a host would run it
+void benchmarkProcessBlock(BenchmarkResults& results, double minTimeMs)
+{
+    const int blockSizes[] { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    const double sampleRates[] { 44100, 48000, 96000, 192000 };
+    // (12 channels is a 7.1.4 bus)
+    const int channelCounts[] { 1, 2, 6, 12 };
+
+    for (auto sampleRate : sampleRates)
+    {
+        for (auto numChannels : channelCounts)
+        {
+            _3BandEQAudioProcessor processor;
+
+            for (int slope = SLOPE_12; slope <= SLOPE_48; slope++)
+            {
+                setParameter(processor, "LowCut_Slope", (float)slope);
+                setParameter(processor, "HighCut_Slope", (float)slope);
+
+                for (auto blockSize : blockSizes)
+                {
+                    // prepareToPlay() designs the filters for the new settings straight away
+                    processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+                    processor.prepareToPlay(sampleRate, blockSize);
+
+                    juce::AudioBuffer<float> noise(numChannels, blockSize), buffer(numChannels, blockSize);
+                    juce::MidiBuffer midiMessages;
+                    fillWithNoise(noise);
+
+                    auto nanoseconds = measureNanosecondsPerCallInPlace([&] { processor.processBlock(buffer, midiMessages); },
+                                                                        buffer, noise, minTimeMs);
+
+                    juce::DynamicObject::Ptr result = new juce::DynamicObject();
+                    result->setProperty("name", "processBlock");
+                    result->setProperty("sample_rate", sampleRate);
+                    result->setProperty("channels", numChannels);
+                    result->setProperty("slope", slopeNames[slope]);
+                    result->setProperty("block_size", blockSize);
+                    result->setProperty("ns_per_sample", nanoseconds / blockSize);
+                    result->setProperty("ns_per_channel_sample", nanoseconds / (blockSize * numChannels));
+                    results.add(result);
+
+                    processor.releaseResources();
+                }
+            }
+        }
+    }
+}
+
+//==============================================================================
+// The scalar chain the SIMD engine replaced: one juce::dsp::IIR::Filter per section per channel.
+// Only here so the two can be compared.
+struct ScalarChain
+{
+    void prepare(const ChainCoefficients& chainCoefficients, int numChannels)
+    {
+        const auto& settings = chainCoefficients.settings;
+        std::vector<DesignedCoefficients> sections;
+
+        for (int i = 0; i <= settings.lowCutSlope; i++)
+            sections.push_back(chainCoefficients.lowCut[(size_t)i]);
+        for (size_t band = 0; band < settings.bands.size(); band++)
+        {
+            if (! settings.bands[band].bypass)
+                sections.push_back(chainCoefficients.bands[band]);
+        }
+        for (int i = 0; i <= settings.highCutSlope; i++)
+            sections.push_back(chainCoefficients.highCut[(size_t)i]);
+
+        filters.clear();
+        filters.resize((size_t)numChannels);
+
+        for (auto& channelFilters : filters)
+        {
+            for (const auto& c : sections)
+            {
+                channelFilters.emplace_back();
+                channelFilters.back().coefficients = new juce::dsp::IIR::Coefficients<float>((float)c.b0, (float)c.b1, (float)c.b2,
+                                                                                            1.f, (float)c.a1, (float)c.a2);
+            }
+        }
+    }
+
+    void process(juce::dsp::AudioBlock<float>& block) noexcept
+    {
+        for (size_t channel = 0; channel < filters.size(); channel++)
+        {
+            auto channelBlock = block.getSingleChannelBlock(channel);
+            juce::dsp::ProcessContextReplacing<float> context(channelBlock);
+
+            for (auto& filter : filters[channel])
+                filter.process(context);
+        }
+    }
+
+    std::vector<std::vector<juce::dsp::IIR::Filter<float>>> filters;
+};
+
+// The IIR chain on its own, SIMD against scalar
+void benchmarkFilterChains(BenchmarkResults& results, double minTimeMs)
+{
+    const int channelCounts[] { 1, 2, 4, 8, 16 };
+    const int blockSize = 512;
+    const double sampleRate = 48000;
+
+    for (auto numChannels : channelCounts)
+    {
+        for (int slope = SLOPE_12; slope <= SLOPE_48; slope++)
+        {
+            auto chainCoefficients = makeChainCoefficients(makeBenchmarkSettings(static_cast<Slope>(slope)), sampleRate);
+
+            juce::AudioBuffer<float> noise(numChannels, blockSize), buffer(numChannels, blockSize);
+            fillWithNoise(noise);
+            juce::dsp::AudioBlock<float> block(buffer);
+
+            IIRChain<float> simdChain;
+            simdChain.prepare((size_t)numChannels, blockSize);
+            // (No gliding and no crossfade, the coefficients never change here)
+            simdChain.setTargetCoefficients(chainCoefficients, 0, 0);
+
+            ScalarChain scalarChain;
+            scalarChain.prepare(chainCoefficients, numChannels);
+
+            // (Each engine filters its own fresh copy of the noise, never the other one's output)
+            auto simdNanoseconds = measureNanosecondsPerCallInPlace([&] { simdChain.process(block, 0, 32); }, buffer, noise, minTimeMs);
+            auto scalarNanoseconds = measureNanosecondsPerCallInPlace([&] { scalarChain.process(block); }, buffer, noise, minTimeMs);
+
+            for (auto [engine, nanoseconds] : { std::pair<const char*, double> { "simd", simdNanoseconds },
+                                                std::pair<const char*, double> { "scalar", scalarNanoseconds } })
+            {
+                juce::DynamicObject::Ptr result = new juce::DynamicObject();
+                result->setProperty("name", "filterChain");
+                result->setProperty("engine", juce::String(engine));
+                result->setProperty("sample_rate", sampleRate);
+                result->setProperty("channels", numChannels);
+                result->setProperty("slope", slopeNames[slope]);
+                result->setProperty("block_size", blockSize);
+                result->setProperty("ns_per_sample", nanoseconds / blockSize);
+                result->setProperty("ns_per_channel_sample", nanoseconds / (blockSize * numChannels));
+                results.add(result);
+            }
+        }
+    }
+}
+
+//==============================================================================
+// One call of each filter design function
+void benchmarkFilterDesign(BenchmarkResults& results, double minTimeMs)
+{
+    const double sampleRate = 48000;
+
+    auto addResult = [&results, sampleRate](const juce::String& name, const juce::String& slope, double nanoseconds)
+    {
+        juce::DynamicObject::Ptr result = new juce::DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("sample_rate", sampleRate);
+        if (slope.isNotEmpty())
+            result->setProperty("slope", slope);
+        result->setProperty("ns_per_call", nanoseconds);
+        results.add(result);
+    };
+
+    for (int slope = SLOPE_12; slope <= SLOPE_48; slope++)
+    {
+        auto settings = makeBenchmarkSettings(static_cast<Slope>(slope));
+
+        addResult("makeLowCutFilter", slopeNames[slope], measureNanosecondsPerCall([&]
+        {
+            benchmarkSink = benchmarkSink + makeLowCutFilter(settings, sampleRate)[0]->getRawCoefficients()[0];
+        }, minTimeMs));
+
+        addResult("makeHighCutFilter", slopeNames[slope], measureNanosecondsPerCall([&]
+        {
+            benchmarkSink = benchmarkSink + makeHighCutFilter(settings, sampleRate)[0]->getRawCoefficients()[0];
+        }, minTimeMs));
+
+        addResult("makeChainCoefficients", slopeNames[slope], measureNanosecondsPerCall([&]
+        {
+            benchmarkSink = benchmarkSink + makeChainCoefficients(settings, sampleRate).bands[0].b0;
+        }, minTimeMs));
+    }
+
+    auto settings = makeBenchmarkSettings(SLOPE_12);
+    addResult("makePeakFilter", {}, measureNanosecondsPerCall([&]
+    {
+        benchmarkSink = benchmarkSink + makePeakFilter(settings, sampleRate)->getRawCoefficients()[0];
+    }, minTimeMs));
+}
+
+//==============================================================================
+// The analyzer's FFT and path generation, at every FFT size
+void benchmarkAnalyzer(BenchmarkResults& results, double minTimeMs)
+{
+    const double sampleRate = 48000;
+    const float negativeInfinity = -48.f;
+    // (a typical analyzer width in pixels)
+    const juce::Rectangle<float> fftBounds { 0.f, 0.f, 600.f, 200.f };
+
+    for (auto order : { ORDER_2048, ORDER_4096, ORDER_8192 })
+    {
+        const auto fftSize = 1 << order;
+
+        juce::AudioBuffer<float> audioData(1, fftSize);
+        fillWithNoise(audioData);
+
+        FFTDataGenerator<std::vector<float>> fftDataGenerator;
+        fftDataGenerator.changeOrder(order);
+
+        auto fftNanoseconds = measureNanosecondsPerCall([&]
+        {
+            fftDataGenerator.produceFFTDataForRendering(audioData, negativeInfinity);
+        }, minTimeMs);
+
+        juce::DynamicObject::Ptr fftResult = new juce::DynamicObject();
+        fftResult->setProperty("name", "produceFFTDataForRendering");
+        fftResult->setProperty("fft_size", fftSize);
+        fftResult->setProperty("ns_per_call", fftNanoseconds);
+        fftResult->setProperty("ns_per_sample", fftNanoseconds / fftSize);
+        results.add(fftResult);
+
+        AnalyzerPathGenerator<juce::Path> pathGenerator;
+        juce::Path path;
+        const auto& fftData = fftDataGenerator.getFFTData();
+        const auto binWidth = (float)(sampleRate / fftSize);
+
+        // Take each path straight back out again, like the analyzer does, so the FIFO never fills up
+        auto pathNanoseconds = measureNanosecondsPerCall([&]
+        {
+            pathGenerator.generatePath(fftData, fftBounds, fftSize, binWidth, negativeInfinity);
+            while (pathGenerator.getNumPathsAvailable() > 0)
+                pathGenerator.getPath(path);
+        }, minTimeMs);
+
+        juce::DynamicObject::Ptr pathResult = new juce::DynamicObject();
+        pathResult->setProperty("name", "generatePath");
+        pathResult->setProperty("fft_size", fftSize);
+        pathResult->setProperty("width", fftBounds.getWidth());
+        pathResult->setProperty("ns_per_call", pathNanoseconds);
+        results.add(pathResult);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // The processor's parameters need a message manager, even if nothing ever runs its loop
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ArgumentList arguments(argc, argv);
+
+    auto minTimeMs = 50.0;
+    if (arguments.containsOption("--min-time"))
+        minTimeMs = juce::jmax(1.0, arguments.getValueForOption("--min-time").getDoubleValue());
+
+    // --filter picks the benchmarks whose names contain it
+    auto filter = arguments.getValueForOption("--filter");
+    auto shouldRun = [&filter](const juce::String& name) { return filter.isEmpty() || name.containsIgnoreCase(filter); };
+
+    BenchmarkResults results;
+
+    if (shouldRun("processBlock"))
+        benchmarkProcessBlock(results, minTimeMs);
+    if (shouldRun("filterChain"))
+        benchmarkFilterChains(results, minTimeMs);
+    if (shouldRun("filterDesign"))
+        benchmarkFilterDesign(results, minTimeMs);
+    if (shouldRun("analyzer"))
+        benchmarkAnalyzer(results, minTimeMs);
+
+    // Enough about the machine and build to tell results apart later
+    juce::DynamicObject::Ptr report = new juce::DynamicObject();
+    report->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("num_cpus", juce::SystemStats::getNumCpus());
+    report->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    report->setProperty("simd_lanes_float", (int)numSIMDLanes<float>);
+    report->setProperty("simd_lanes_double", (int)numSIMDLanes<double>);
+   #if JUCE_DEBUG
+    report->setProperty("build", "debug");
+   #else
+    report->setProperty("build", "release");
+   #endif
+    report->setProperty("min_time_ms", minTimeMs);
+    report->setProperty("results", results.results);
+
+    auto json = juce::JSON::toString(juce::var(report.get()));
+
+    if (arguments.containsOption("--output"))
+    {
+        auto outputFile = arguments.getFileForOption("--output");
+        if (! outputFile.replaceWithText(json))
+        {
+            std::cerr << "Can't write " << outputFile.getFullPathName() << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::cout << json << std::endl;
+    }
+
+    return 0;
+}
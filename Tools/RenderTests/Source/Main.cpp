@@ -0,0 +1,189 @@
+/*
+  ==============================================================================
+
+    Render tests: offline renders have to come out the same every time,...
+    ...whatever the machine's background threads are up to.
+
+    Usage:
+      3BandEQRenderTests
+
+    Prints each failure, and exits with 1 if there were any.
+    Renders go the same way as in the batch renderer: one processor, set to...
+    ...non-realtime and reused for every render, with the latency trimmed off the start.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "../../../Source/PluginProcessor.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+
+constexpr double sampleRate = 48000.0;
+constexpr int blockSize = 512;
+constexpr int numChannels = 2;
+
+int numFailures = 0;
+
+void expect(bool condition, const juce::String& description)
+{
+    if (condition)
+        return;
+
+    std::cerr << "FAILED: " << description << std::endl;
+    numFailures++;
+}
+
+void setParameter(_3BandEQAudioProcessor& processor, const juce::String& parameterID, float value)
+{
+    auto* parameter = dynamic_cast<juce::RangedAudioParameter*>(processor.APVTS.getParameter(parameterID));
+    jassert(parameter != nullptr);
+    parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+}
+
+// A couple of seconds of noise, standing in for the file
+juce::AudioBuffer<float> makeInput()
+{
+    juce::AudioBuffer<float> input(numChannels, (int)sampleRate * 2);
+    juce::Random random(3);
+
+    for (int channel = 0; channel < numChannels; channel++)
+        for (int i = 0; i < input.getNumSamples(); i++)
+            input.setSample(channel, i, random.nextFloat() * 0.5f - 0.25f);
+
+    return input;
+}
+
+// The batch renderer's loop: render past the end by the latency, and drop that much from the start
+juce::AudioBuffer<float> render(_3BandEQAudioProcessor& processor, const juce::AudioBuffer<float>& input)
+{
+    processor.setPlayConfigDetails(numChannels, numChannels, sampleRate, blockSize);
+    processor.prepareToPlay(sampleRate, blockSize);
+
+    const auto latency = processor.getLatencySamples();
+    const auto numSamplesToRender = input.getNumSamples() + latency;
+
+    juce::AudioBuffer<float> output(numChannels, input.getNumSamples());
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midiMessages;
+
+    for (int position = 0; position < numSamplesToRender; position += blockSize)
+    {
+        const auto numSamples = juce::jmin(blockSize, numSamplesToRender - position);
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        buffer.clear();
+
+        // (Silence past the end of the input, like the reader gives us)
+        const auto numInputSamples = juce::jlimit(0, numSamples, input.getNumSamples() - position);
+        for (int channel = 0; channel < numChannels; channel++)
+            buffer.copyFrom(channel, 0, input, channel, position, numInputSamples);
+
+        processor.processBlock(buffer, midiMessages);
+
+        for (int i = 0; i < numSamples; i++)
+        {
+            const auto outputPosition = position + i - latency;
+            if (outputPosition >= 0 && outputPosition < output.getNumSamples())
+                for (int channel = 0; channel < numChannels; channel++)
+                    output.setSample(channel, outputPosition, buffer.getSample(channel, i));
+        }
+    }
+
+    processor.releaseResources();
+    return output;
+}
+
+bool isBitIdentical(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b)
+{
+    if (a.getNumChannels() != b.getNumChannels() || a.getNumSamples() != b.getNumSamples())
+        return false;
+
+    for (int channel = 0; channel < a.getNumChannels(); channel++)
+        if (std::memcmp(a.getReadPointer(channel), b.getReadPointer(channel), sizeof(float) * (size_t)a.getNumSamples()) != 0)
+            return false;
+
+    return true;
+}
+
+float getMaxDifference(const juce::AudioBuffer<float>& a, const juce::AudioBuffer<float>& b, int numSamples)
+{
+    auto maxDifference = 0.f;
+    for (int channel = 0; channel < a.getNumChannels(); channel++)
+        for (int i = 0; i < numSamples; i++)
+            maxDifference = juce::jmax(maxDifference, std::abs(a.getSample(channel, i) - b.getSample(channel, i)));
+
+    return maxDifference;
+}
+
+//==============================================================================
+
+// The same file rendered twice, by the same worker, comes out the same both times
+void testRendersAreIdentical(bool linearPhase)
+{
+    const auto name = juce::String(linearPhase ? "linear phase" : "minimum phase");
+
+    _3BandEQAudioProcessor processor;
+    processor.setNonRealtime(true);
+
+    setParameter(processor, "Phase_Mode", linearPhase ? 1.f : 0.f);
+    setParameter(processor, "LowCut_Freq", 80.f);
+    setParameter(processor, "Peak_Freq", 1000.f);
+    setParameter(processor, "Peak_Gain", 6.f);
+    setParameter(processor, "HighCut_Freq", 12000.f);
+
+    const auto input = makeInput();
+    const auto first = render(processor, input);
+    const auto second = render(processor, input);
+
+    expect(isBitIdentical(first, second), name + ": rendering the same input twice gives the same output");
+}
+
+// With every filter switched off, the linear phase kernel is a plain delay, which the render...
+// ...trims back off. So the output is the input, right from the first block: nothing goes...
+// ...through an old or empty kernel while the new one loads.
+void testLinearPhaseKernelIsInPlaceFromTheStart()
+{
+    _3BandEQAudioProcessor processor;
+    processor.setNonRealtime(true);
+
+    setParameter(processor, "Phase_Mode", 1.f);
+    setParameter(processor, "LowCut_Bypass", 1.f);
+    setParameter(processor, "HighCut_Bypass", 1.f);
+    setParameter(processor, "Peak_Bypass", 1.f);
+
+    const auto input = makeInput();
+    const auto output = render(processor, input);
+
+    expect(processor.getLatencySamples() > 0, "linear phase reports its latency");
+    expect(getMaxDifference(input, output, blockSize * 4) < 1.0e-3f, "the first blocks of a linear phase render are already filtered");
+    expect(getMaxDifference(input, output, input.getNumSamples()) < 1.0e-3f, "a flat linear phase render gives back its input");
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    // The processor's parameters need a message manager, even if nothing ever runs its loop
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    testRendersAreIdentical(false);
+    testRendersAreIdentical(true);
+    testLinearPhaseKernelIsInPlaceFromTheStart();
+
+    if (numFailures > 0)
+    {
+        std::cerr << numFailures << " render test(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All render tests passed" << std::endl;
+    return 0;
+}
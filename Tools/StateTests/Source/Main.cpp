@@ -0,0 +1,271 @@
+/*
+  ==============================================================================
+
+    State tests: checks the binary state format against a checked in fixture,...
+    ...so a change that would break old sessions shows up here.
+
+    Usage:
+      3BandEQStateTests
+
+    Prints each failure, and exits with 1 if there were any.
+    Fixtures/state_v1.bin is built into the binary (see the .jucer). It was written...
+    ...by hand from the format in writeBinaryState(), not by this plugin, so it...
+    ...also pins down the ID hash. It only holds some of the parameters (plus one...
+    ...this version doesn't have), the way a state from another version would.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+
+#include "../../../Source/PluginProcessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+// What's in the fixture, in the order it's in there
+const std::vector<std::pair<juce::String, float>> fixtureValues
+{
+    { "LowCut_Freq", 120.f },
+    { "LowCut_Slope", 2.f },
+    { "HighCut_Freq", 8000.f },
+    { "HighCut_Bypass", 1.f },
+    { "Peak_Freq", 1000.f },
+    { "Peak_Gain", 6.f },
+    { "Peak_Q", 2.f },
+    { "Peak3_Freq", 200.f },
+    { "Peak3_Gain", -4.5f },
+    { "Peak3_Bypass", 0.f },
+    { "Peak3_Type", 1.f },
+    { "Phase_Mode", 1.f },
+    { "Oversampling", 1.f },
+    // Not a parameter (any more), so loading should skip it
+    { "Removed_Parameter", 42.f }
+};
+
+constexpr juce::uint32 expectedMagic = 0x51454233; // "3BEQ"
+constexpr juce::uint32 expectedVersion = 1;
+
+int numFailures = 0;
+
+void expect(bool condition, const juce::String& description)
+{
+    if (condition)
+        return;
+
+    std::cerr << "FAILED: " << description << std::endl;
+    numFailures++;
+}
+
+bool isClose(float a, float b)
+{
+    return std::abs(a - b) <= 1.0e-4f * juce::jmax(1.f, std::abs(b));
+}
+
+juce::MemoryBlock getFixture()
+{
+    return juce::MemoryBlock(BinaryData::state_v1_bin, (size_t)BinaryData::state_v1_binSize);
+}
+
+juce::MemoryBlock getState(_3BandEQAudioProcessor& processor)
+{
+    juce::MemoryBlock state;
+    processor.getStateInformation(state);
+    return state;
+}
+
+void setState(_3BandEQAudioProcessor& processor, const juce::MemoryBlock& state)
+{
+    processor.setStateInformation(state.getData(), (int)state.getSize());
+}
+
+juce::RangedAudioParameter* getParameter(_3BandEQAudioProcessor& processor, const juce::String& parameterID)
+{
+    return dynamic_cast<juce::RangedAudioParameter*>(processor.APVTS.getParameter(parameterID));
+}
+
+// In the same units the state saves them in
+float getValue(const juce::RangedAudioParameter& parameter)
+{
+    return parameter.convertFrom0to1(parameter.getValue());
+}
+
+// A binary state, taken apart again
+struct BinaryState
+{
+    juce::uint32 magic {0}, version {0};
+    std::vector<std::pair<juce::uint32, float>> entries;
+
+    explicit BinaryState(const juce::MemoryBlock& state)
+    {
+        juce::MemoryInputStream stream(state, false);
+        magic = (juce::uint32)stream.readInt();
+        version = (juce::uint32)stream.readInt();
+
+        auto numEntries = juce::jmax(0, stream.readInt());
+        while (numEntries-- > 0 && stream.getNumBytesRemaining() >= 8)
+        {
+            auto hash = (juce::uint32)stream.readInt();
+            entries.emplace_back(hash, stream.readFloat());
+        }
+    }
+
+    const std::pair<juce::uint32, float>* find(juce::uint32 hash) const
+    {
+        for (const auto& entry : entries)
+            if (entry.first == hash)
+                return &entry;
+
+        return nullptr;
+    }
+};
+
+//==============================================================================
+
+// Loading the fixture sets what it has, and puts everything else back to its default
+void testLoadsFixture()
+{
+    _3BandEQAudioProcessor processor;
+
+    // Move something the fixture doesn't mention, to check it gets reset
+    auto* untouched = getParameter(processor, "Peak2_Gain");
+    expect(untouched != nullptr, "Peak2_Gain exists");
+    if (untouched != nullptr)
+        untouched->setValueNotifyingHost(untouched->convertTo0to1(12.f));
+
+    setState(processor, getFixture());
+
+    for (const auto& [parameterID, value] : fixtureValues)
+    {
+        auto* parameter = getParameter(processor, parameterID);
+        if (parameterID == "Removed_Parameter")
+        {
+            expect(parameter == nullptr, "Removed_Parameter isn't a parameter");
+            continue;
+        }
+
+        expect(parameter != nullptr, parameterID + " exists");
+        if (parameter != nullptr)
+            expect(isClose(getValue(*parameter), value),
+                   parameterID + " loads as " + juce::String(value) + ", not " + juce::String(getValue(*parameter)));
+    }
+
+    for (auto* p : processor.getParameters())
+    {
+        auto* parameter = dynamic_cast<juce::RangedAudioParameter*>(p);
+        if (parameter == nullptr)
+            continue;
+
+        auto inFixture = std::any_of(fixtureValues.begin(), fixtureValues.end(),
+                                     [parameter](const auto& value) { return value.first == parameter->paramID; });
+        if (! inFixture)
+            expect(parameter->getValue() == parameter->getDefaultValue(), parameter->paramID + " goes back to its default");
+    }
+}
+
+// Saving writes every parameter, under the same hashes the fixture uses
+void testSavesFixtureHashes()
+{
+    _3BandEQAudioProcessor processor;
+    setState(processor, getFixture());
+
+    const BinaryState fixture(getFixture());
+    const BinaryState saved(getState(processor));
+
+    expect(fixture.entries.size() == fixtureValues.size(), "the fixture has every entry");
+    expect(saved.magic == expectedMagic, "the saved state starts with \"3BEQ\"");
+    expect(saved.version == expectedVersion, "the saved state is version " + juce::String(expectedVersion));
+    expect(saved.entries.size() == (size_t)processor.getParameters().size(), "the saved state has every parameter");
+
+    for (size_t i = 0; i < juce::jmin(fixture.entries.size(), fixtureValues.size()); i++)
+    {
+        const auto& parameterID = fixtureValues[i].first;
+        auto* entry = saved.find(fixture.entries[i].first);
+
+        if (parameterID == "Removed_Parameter")
+        {
+            expect(entry == nullptr, "Removed_Parameter isn't saved");
+            continue;
+        }
+
+        expect(entry != nullptr, parameterID + " is saved under the fixture's hash");
+        if (entry != nullptr)
+            expect(isClose(entry->second, fixtureValues[i].second), parameterID + " saves the value it loaded");
+    }
+}
+
+// A state saved by one instance recalls exactly into another
+void testRoundTrip()
+{
+    _3BandEQAudioProcessor source, destination;
+    setState(source, getFixture());
+
+    setState(destination, getState(source));
+
+    for (auto* p : source.getParameters())
+    {
+        auto* parameter = dynamic_cast<juce::RangedAudioParameter*>(p);
+        if (parameter == nullptr)
+            continue;
+
+        auto* recalled = getParameter(destination, parameter->paramID);
+        expect(recalled != nullptr && isClose(getValue(*recalled), getValue(*parameter)), parameter->paramID + " round trips");
+    }
+
+    expect(getState(source) == getState(destination), "saving the recalled state gives the same bytes");
+}
+
+// States from a newer version are left alone rather than half understood
+void testIgnoresNewerVersion()
+{
+    _3BandEQAudioProcessor processor;
+    const auto before = getState(processor);
+    // (getState() only looks at the parameters, so check the APVTS tree itself wasn't replaced either)
+    const auto treeBefore = processor.APVTS.state.createCopy();
+
+    auto newer = getFixture();
+    // (The version is the second little endian int of the header)
+    static_cast<juce::uint8*>(newer.getData())[4] = (juce::uint8)(expectedVersion + 1);
+
+    setState(processor, newer);
+
+    expect(getState(processor) == before, "a state from a newer version doesn't change anything");
+    expect(processor.APVTS.state.getType() == treeBefore.getType(), "a state from a newer version keeps the APVTS tree's type");
+    expect(processor.APVTS.state.isEquivalentTo(treeBefore), "a state from a newer version leaves the APVTS tree alone");
+
+    // Cut short after the magic: still ours, so it mustn't be read as a ValueTree either
+    setState(processor, juce::MemoryBlock(newer.getData(), 8));
+
+    expect(getState(processor) == before, "a truncated binary state doesn't change anything");
+    expect(processor.APVTS.state.isEquivalentTo(treeBefore), "a truncated binary state leaves the APVTS tree alone");
+}
+
+} // namespace
+
+//==============================================================================
+
+int main()
+{
+    // The processor's parameters need a message manager, even if nothing ever runs its loop
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    testLoadsFixture();
+    testSavesFixtureHashes();
+    testRoundTrip();
+    testIgnoresNewerVersion();
+
+    if (numFailures > 0)
+    {
+        std::cerr << numFailures << " state test(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All state tests passed" << std::endl;
+    return 0;
+}